@@ -66,7 +66,11 @@ static volatile uint8_t updatedisplay;
 
 /* Menu state */
 static enum { MST_INACTIVE = 0, MST_RESET, MST_INIT, MST_ACTIVE } menustate;
-static int8_t menuentry;
+static int16_t menuentry;
+static uint8_t menurequest[3];
+static uint8_t capabilities[3] = { DISPLAY_CAPS_MAGIC,
+                                   DISPLAY_CAP_WINDOWED,
+                                   (uint8_t)~DISPLAY_CAP_WINDOWED };
 
 /* I2C rx buffer and tx pointers */
 static uint8_t rxbuffer[CONFIG_I2C_BUFFER_SIZE];
@@ -309,14 +313,38 @@ static void parse_display(uint8_t length, uint8_t *data) {
     break;
 
   case DISPLAY_MENU_GETSELECTION:
+    /* little endian, drives reading a single byte get the low byte */
     txdata = (uint8_t *)&menuentry;
-    txlen = 1;
+    txlen = 2;
     break;
 
   case DISPLAY_MENU_GETENTRY:
-    asc2pet((uint8_t *)menulines[menuentry]);
-    txdata = (uint8_t *)menulines[menuentry];
-    txlen = strlen(menulines[menuentry]);
+    txdata = (uint8_t *)menu_entry(menuentry);
+    if (txdata == NULL) {
+      txlen = 0;
+    } else {
+      asc2pet(txdata);
+      txlen = strlen((char *)txdata);
+    }
+    break;
+
+  case DISPLAY_MENU_SETSIZE:
+    menu_setsize(data[1] | (data[2] << 8));
+    break;
+
+  case DISPLAY_MENU_SETWINDOW:
+    menu_setwindow(data[1] | (data[2] << 8));
+    break;
+
+  case DISPLAY_MENU_GETREQUEST:
+    menu_getrequest(menurequest);
+    txdata = menurequest;
+    txlen = sizeof(menurequest);
+    break;
+
+  case DISPLAY_GETCAPS:
+    txdata = capabilities;
+    txlen = sizeof(capabilities);
     break;
   }
 }
@@ -521,9 +549,14 @@ int main(void) {
       update_display();
     }
 
+    /* Ask the drive for missing menu entries */
+    if (menustate == MST_ACTIVE && menu_raise_request())
+      set_intrq(0);
+
     curkey = button_state;
     if (!prevkey && curkey) {
       if (menustate == MST_ACTIVE) {
+        menu_cancelrequest();
         menustate = MST_RESET;
       }
       set_intrq(0);
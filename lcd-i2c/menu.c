@@ -21,7 +21,9 @@
 
 #include "config.h"
 #include <avr/io.h>
+#include <util/atomic.h>
 #include <string.h>
+#include "display.h"
 #include "encoder.h"
 #include "lcd.h"
 #include "timer.h"
@@ -34,16 +36,85 @@ static uint8_t entrycount;
 static char *menuheap;
 extern char __heap_start;
 
-static void show_menu(char **entries, uint8_t count, uint8_t start) {
+/* Windowed menus: index of menulines[0] and total number of entries */
+static uint16_t menubase;
+static uint16_t menusize;
+static volatile uint8_t windowchanged;
+
+/* Request for a window of entries from the drive */
+static uint16_t reqstart;
+static volatile enum { REQ_NONE = 0, REQ_PENDING, REQ_RAISED, REQ_WAITING } reqstate;
+
+/**
+ * menu_count - return the number of menu entries
+ */
+static uint16_t menu_count(void) {
+  if (menusize)
+    return menusize;
+  else
+    return entrycount;
+}
+
+/**
+ * menu_entry - return the text of a menu entry
+ * @index: number of the entry
+ *
+ * This function returns a pointer to the text of the menu entry
+ * index or NULL if it is not in the buffer.
+ */
+char *menu_entry(uint16_t index) {
+  char *entry = NULL;
+
+  ATOMIC_BLOCK(ATOMIC_FORCEON) {
+    if (index >= menubase && index - menubase < entrycount)
+      entry = menulines[index - menubase];
+  }
+  return entry;
+}
+
+/**
+ * request_window - ask the drive for the entries around an entry
+ * @index: first entry that must be included
+ *
+ * This function sets up a request for a window of entries, the
+ * main loop signals it to the drive using the interrupt line.
+ */
+static void request_window(uint16_t index) {
+  int16_t start;
+
+  if (reqstate != REQ_NONE)
+    return;
+
+  start = index - (DISPLAY_MENU_WINDOW - LCD_ROWS) / 2;
+  if (start > (int16_t)menusize - DISPLAY_MENU_WINDOW)
+    start = menusize - DISPLAY_MENU_WINDOW;
+  if (start < 0)
+    start = 0;
+
+  ATOMIC_BLOCK(ATOMIC_FORCEON) {
+    reqstart = start;
+    reqstate = REQ_PENDING;
+  }
+}
+
+static void show_menu(uint16_t count, uint16_t start) {
   uint8_t i,j;
+  char *entry;
 
   lcd_gotoxy(0,0);
   lcd_putch(' ');
 
   /* Output menu entries */
-  for (i=0;i<min(count-start,LCD_ROWS);i++) {
-    for (j=0;j<LCD_COLUMNS-1 && entries[i+start][j];j++)
-      lcd_putch(entries[i+start][j]);
+  for (i=0;i<LCD_ROWS && i<count-start;i++) {
+    entry = menu_entry(i+start);
+    if (entry == NULL) {
+      /* not received yet */
+      request_window(i+start);
+      j = 0;
+    } else {
+      for (j=0;j<LCD_COLUMNS-1 && entry[j];j++)
+        lcd_putch(entry[j]);
+    }
     for (;j<LCD_COLUMNS;j++)
       lcd_putch(' ');
   }
@@ -54,6 +125,16 @@ static void show_menu(char **entries, uint8_t count, uint8_t start) {
       lcd_putch(' ');
 }
 
+/* Length of a menu entry, 0 if it is not in the buffer */
+static uint8_t entry_length(uint16_t index) {
+  char *entry = menu_entry(index);
+
+  if (entry == NULL)
+    return 0;
+  else
+    return strlen(entry);
+}
+
 void menu_init(void) {
   /* Arrow for highlighing an entry */
   lcd_customchar(3,0x08,0x0c,0x0e,0x0f,0x0e,0x0c,0x08,0x00);
@@ -63,8 +144,51 @@ void menu_init(void) {
 void menu_resetlines(void) {
   menuheap = &__heap_start;
   entrycount = 0;
+  menubase = 0;
+  menusize = 0;
+  reqstate = REQ_NONE;
+}
+
+void menu_setsize(uint16_t size) {
+  menusize = size;
 }
-  
+
+void menu_setwindow(uint16_t start) {
+  menuheap = &__heap_start;
+  entrycount = 0;
+  menubase = start;
+  reqstate = REQ_NONE;
+  windowchanged = 1;
+}
+
+/* Called from the I2C interrupt: fill buf with the current request */
+void menu_getrequest(uint8_t *buf) {
+  if (reqstate == REQ_PENDING || reqstate == REQ_RAISED) {
+    buf[0] = 1;
+    buf[1] = reqstart & 0xff;
+    buf[2] = reqstart >> 8;
+    reqstate = REQ_WAITING;
+  } else {
+    buf[0] = 0;
+  }
+}
+
+uint8_t menu_raise_request(void) {
+  uint8_t res = 0;
+
+  ATOMIC_BLOCK(ATOMIC_FORCEON) {
+    if (reqstate == REQ_PENDING) {
+      reqstate = REQ_RAISED;
+      res = 1;
+    }
+  }
+  return res;
+}
+
+void menu_cancelrequest(void) {
+  reqstate = REQ_NONE;
+}
+
 uint8_t menu_addline(char *line) {
   /* Check remaining heap space */
   if (((uint16_t)menuheap+strlen(line)+1) > SP-32 || entrycount >= CONFIG_MAX_MENU_ENTRIES) {
@@ -74,16 +198,19 @@ uint8_t menu_addline(char *line) {
   strcpy(menuheap,line);
   menulines[entrycount++] = menuheap;
   menuheap += strlen(line)+1;
+  windowchanged = 1;
 
   return 0;
 }
 
 
-uint8_t menu_display(uint8_t init, uint8_t startentry) {
-  static int8_t  prevoffset,curoffset,preventry,scrollofs;
-  static int8_t  curencoder,prevencoder,curentry;
+int16_t menu_display(uint8_t init, int16_t startentry) {
+  static int16_t prevoffset,curoffset,preventry,curentry;
+  static int8_t  curencoder,prevencoder,scrollofs;
   static uint8_t entrylen;
   static tick_t  scrolltime;
+  int16_t count = menu_count();
+  char *entry;
 
   if (init) {
     lcd_setcursormode(LCD_CURSOR_NONE);
@@ -91,17 +218,17 @@ uint8_t menu_display(uint8_t init, uint8_t startentry) {
 
     prevencoder = encoder_position;
     prevoffset  = -1;
-    preventry   = curentry;
     scrollofs   = -1;
     scrolltime  = 0;
-    entrylen    = strlen(menulines[curentry]);
-    if (startentry < entrycount)
+    if (startentry >= 0 && startentry < count)
       curentry = startentry;
     else
       curentry = 0;
+    preventry   = curentry;
+    entrylen    = entry_length(curentry);
 
     curoffset = curentry-LCD_ROWS/2+1;
-    if (curoffset+LCD_ROWS-1 >= entrycount) curoffset = entrycount-LCD_ROWS;
+    if (curoffset+LCD_ROWS-1 >= count) curoffset = count-LCD_ROWS;
     if (curoffset < 0) curoffset = 0;
   }
 
@@ -109,54 +236,62 @@ uint8_t menu_display(uint8_t init, uint8_t startentry) {
 
   /* Encoder position changed */
   if (curencoder != prevencoder) {
-    curentry += (curencoder-prevencoder);
-    if (curentry >= entrycount) curentry = 0;
-    if (curentry < 0) curentry = entrycount-1;
+    curentry += (int8_t)(curencoder-prevencoder);
+    if (curentry >= count) curentry = 0;
+    if (curentry < 0) curentry = count-1;
   }
 
   /* Move offset until the marker is back into visible area */
   while (curentry-curoffset < 1 && curoffset > 0) curoffset--;
-  while (curentry-curoffset >= LCD_ROWS-1 && curentry < entrycount-1) curoffset++;
+  while (curentry-curoffset >= LCD_ROWS-1 && curentry < count-1) curoffset++;
   if (curentry-curoffset >= LCD_ROWS) {
     /* Special case for wrapping to the last entry */
     curoffset = curentry-LCD_ROWS+1;
   }
 
+  /* Entries of a windowed menu were received */
+  if (windowchanged) {
+    windowchanged = 0;
+    prevoffset = -1;
+  }
+
   /* Redraw when offset changed */
   if (curoffset != prevoffset) {
-    show_menu(menulines,entrycount,curoffset);
+    show_menu(count,curoffset);
     prevoffset = curoffset;
     scrollofs  = -1;
 
     lcd_gotoxy(0,curentry-curoffset);
     lcd_putch(3);
 
-    entrylen = strlen(menulines[curentry]);
+    entrylen = entry_length(curentry);
     preventry = curentry;
   } else if (preventry != curentry) {
     /* Move marker if only the entry changed */
     lcd_gotoxy(0,preventry-curoffset);
     lcd_putch(' ');
 
-    if (scrollofs != -1) {
+    entry = menu_entry(preventry);
+    if (scrollofs != -1 && entry != NULL) {
       uint8_t i;
 
       lcd_gotoxy(1,preventry-curoffset);
       for (i=0;i<LCD_COLUMNS-1;i++)
-        lcd_putch(menulines[preventry][i]);
-      scrollofs = -1;
+        lcd_putch(entry[i]);
     }
+    scrollofs = -1;
 
     lcd_gotoxy(0,curentry-curoffset);
     lcd_putch(3);
 
-    entrylen = strlen(menulines[curentry]);
+    entrylen = entry_length(curentry);
 
     preventry = curentry;
   }
 
   /* Current entry is too long -> scroll */
-  if (entrylen >= LCD_COLUMNS) {
+  entry = menu_entry(curentry);
+  if (entry != NULL && entrylen >= LCD_COLUMNS) {
     if (scrollofs == -1) {
       /* Haven't scrolled yet, start in a few ticks */
       scrollofs  = 0;
@@ -172,11 +307,11 @@ uint8_t menu_display(uint8_t init, uint8_t startentry) {
       lcd_gotoxy(1,curentry-curoffset);
       for (i=0;i<LCD_COLUMNS-1;i++) {
         if (scrollofs+i < entrylen) {
-          lcd_putch(menulines[curentry][scrollofs+i]);
+          lcd_putch(entry[scrollofs+i]);
         } else if (scrollofs+i < entrylen+3) {
           lcd_putch(' ');
         } else
-          lcd_putch(menulines[curentry][scrollofs+i-entrylen-3]);
+          lcd_putch(entry[scrollofs+i-entrylen-3]);
       }
     }
   }
@@ -25,8 +25,16 @@
 extern char *menulines[CONFIG_MAX_MENU_ENTRIES];
 
 void    menu_init(void);
-uint8_t menu_display(uint8_t init, uint8_t startentry);
+int16_t menu_display(uint8_t init, int16_t startentry);
 void    menu_resetlines(void);
 uint8_t menu_addline(char *line);
+char   *menu_entry(uint16_t index);
+
+/* Windowed menus, the entries are requested from the drive on demand */
+void    menu_setsize(uint16_t size);
+void    menu_setwindow(uint16_t start);
+void    menu_getrequest(uint8_t *buf);
+uint8_t menu_raise_request(void);
+void    menu_cancelrequest(void);
 
 #endif
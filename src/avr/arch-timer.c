@@ -37,3 +37,44 @@ void timer_init(void) {
   TCCR1B = _BV(WGM12) | _BV(CS10) | _BV(CS11);
   TIMSK1 |= _BV(OCIE1A);
 }
+
+#ifdef CONFIG_PROFILING
+/**
+ * cycle_count - return a timestamp for cycle_diff
+ *
+ * This function combines the tick counter (upper 16 bits) and
+ * timer 1 (lower 16 bits) into a timestamp. Only the difference of
+ * two timestamps calculated by cycle_diff has a meaning.
+ */
+uint32_t cycle_count(void) {
+  uint16_t count;
+  tick_t   tick;
+
+  ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+    count = TCNT1;
+    tick  = ticks;
+    /* Timer 1 has wrapped, but the tick interrupt didn't run yet */
+    if ((TIFR1 & _BV(OCF1A)) && count < OCR1A / 2)
+      tick++;
+  }
+
+  return ((uint32_t)tick << 16) | count;
+}
+
+/**
+ * cycle_diff - return the number of CPU cycles between two timestamps
+ * @start: timestamp of the start
+ * @end  : timestamp of the end
+ *
+ * This function returns the number of CPU cycles between two values
+ * returned by cycle_count with a resolution of 64 cycles. Ticks and
+ * timer counts are subtracted separately, so the result stays correct
+ * when the tick counter wraps between @start and @end.
+ */
+uint32_t cycle_diff(uint32_t start, uint32_t end) {
+  uint16_t ticks_diff = (uint16_t)(end >> 16) - (uint16_t)(start >> 16);
+  int32_t  count_diff = (int32_t)(uint16_t)end - (uint16_t)start;
+
+  return ((uint32_t)ticks_diff * (OCR1A + 1) + count_diff) * 64;
+}
+#endif
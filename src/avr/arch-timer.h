@@ -35,6 +35,11 @@
 typedef uint16_t tick_t;
 typedef int16_t stick_t;
 
+#ifdef CONFIG_PROFILING
+uint32_t cycle_count(void);
+uint32_t cycle_diff(uint32_t start, uint32_t end);
+#endif
+
 /**
  * start_timeout - start a timeout using timer0
  * @usecs: number of microseconds before timeout (maximum 256 for 8MHz clock)
@@ -40,6 +40,7 @@
 
 
 static DSTATUS ATA_drv_flags[2];
+static BYTE ATA_drv_multiple[2];  /* sectors per data request, 1 without READ MULTIPLE */
 
 #define ATA_WRITE_CMD(cmd) { ata_write_reg(ATA_REG_CMD,cmd); }
 
@@ -200,7 +201,8 @@ void disk_init(void) __attribute__ ((weak, alias("ata_init")));
 /*-----------------------------------------------------------------------*/
 
 DSTATUS ata_initialize (BYTE drv) {
-  BYTE data[(83 - 49 + 1) * 2];
+  BYTE data[(83 - 47 + 1) * 2];
+  BYTE multiple;
   DWORD i = DELAY_VALUE(ATA_INIT_TIMEOUT);
 
   if(drv>1) return STA_NOINIT;
@@ -231,12 +233,28 @@ DSTATUS ata_initialize (BYTE drv) {
   } while(ata_read_reg(ATA_REG_STATUS) & ATA_STATUS_BSY);  /* Wait cmd ready */
   ATA_WRITE_CMD(ATA_CMD_IDENTIFY);
   if(!ata_wait_data()) goto di_error;
-  ata_read_part(data, 49, 83 - 49 + 1);
-  if(!(data[1] & 0x02)) goto di_error; /* No LBA support */
-  if(data[(83 - 49) * 2 + 1] & 0x04)   /* 48 bit addressing... */
+  ata_read_part(data, 47, 83 - 47 + 1);
+  if(!(data[(49 - 47) * 2 + 1] & 0x02)) goto di_error; /* No LBA support */
+  if(data[(83 - 47) * 2 + 1] & 0x04)   /* 48 bit addressing... */
     ATA_drv_flags[drv] |= STA_48BIT;
   ATA_drv_flags[drv] &= (BYTE)~( STA_NOINIT | STA_NODISK);
 
+  /* Transfer multiple sectors per data request if the drive can */
+  multiple = ATA_MAX_MULTIPLE;
+  while (multiple > data[0])          /* Word 47: max sectors per request */
+    multiple >>= 1;
+  ATA_drv_multiple[drv] = 1;
+  if (multiple > 1) {
+    ata_write_reg(ATA_REG_COUNT, multiple);
+    ATA_WRITE_CMD(ATA_CMD_SET_MULTIPLE);
+    i = DELAY_VALUE(1000);
+    do {
+      if(!--i) goto di_error;
+    } while(ata_read_reg(ATA_REG_STATUS) & ATA_STATUS_BSY);
+    if (!(ata_read_reg(ATA_REG_STATUS) & ATA_STATUS_ERR))
+      ATA_drv_multiple[drv] = multiple;
+  }
+
   disk_state = DISK_OK;
   return 0;
 
@@ -264,35 +282,44 @@ DSTATUS disk_status (BYTE drv) __attribute__ ((weak, alias("ata_status")));
 /*-----------------------------------------------------------------------*/
 
 DRESULT ata_read (BYTE drv, BYTE *data, DWORD sector, BYTE count) {
-  BYTE c, iord_l, iord_h;
+  BYTE c, block, multiple, iord_l, iord_h;
 
   if (drv > 1 || !count) return RES_PARERR;
   if (ATA_drv_flags[drv] & STA_NOINIT) return RES_NOTRDY;
 
-  /* Issue Read Sector(s) command */
+  /* Issue Read Sector(s) or Read Multiple command */
+  multiple = (count > 1) ? ATA_drv_multiple[drv] : 1;
   ata_select_sector(drv, sector, count);
-  ATA_WRITE_CMD(ATA_drv_flags[drv] & STA_48BIT ? ATA_CMD_READ_EXT : ATA_CMD_READ);
+  if (multiple > 1)
+    c = ATA_drv_flags[drv] & STA_48BIT ? ATA_CMD_READ_MULTIPLE_EXT : ATA_CMD_READ_MULTIPLE;
+  else
+    c = ATA_drv_flags[drv] & STA_48BIT ? ATA_CMD_READ_EXT : ATA_CMD_READ;
+  ATA_WRITE_CMD(c);
 
   iord_h = ATA_REG_DATA;
   iord_l = ATA_REG_DATA & (BYTE)~ATA_PIN_RD;
   do {
     if (!ata_wait_data()) return RES_ERROR; /* Wait data ready */
     ATA_PORT_CTRL_OUT = ATA_REG_DATA;
-    c = 0;
-    do {
-      ATA_PORT_CTRL_OUT = iord_l;       /* IORD = L */
-      ATA_PORT_CTRL_OUT = iord_l;       /* delay */
-      ATA_PORT_CTRL_OUT = iord_l;       /* delay */
-      ATA_PORT_CTRL_OUT = iord_l;       /* delay */
-      ATA_PORT_CTRL_OUT = iord_l;       /* delay */
-      *data++ = ATA_PORT_DATA_LO_IN;    /* Get even data */
-      *data++ = ATA_PORT_DATA_HI_IN;    /* Get odd data */
-      ATA_PORT_CTRL_OUT = iord_h;       /* IORD = H */
-      ATA_PORT_CTRL_OUT = iord_h;       /* delay */
-      ATA_PORT_CTRL_OUT = iord_h;       /* delay */
-      ATA_PORT_CTRL_OUT = iord_h;       /* delay */
-    } while (++c);
-  } while (--count);
+    block = (count < multiple) ? count : multiple;
+    count -= block;
+    do {                                /* All sectors of this data request */
+      c = 0;
+      do {
+        ATA_PORT_CTRL_OUT = iord_l;     /* IORD = L */
+        ATA_PORT_CTRL_OUT = iord_l;     /* delay */
+        ATA_PORT_CTRL_OUT = iord_l;     /* delay */
+        ATA_PORT_CTRL_OUT = iord_l;     /* delay */
+        ATA_PORT_CTRL_OUT = iord_l;     /* delay */
+        *data++ = ATA_PORT_DATA_LO_IN;  /* Get even data */
+        *data++ = ATA_PORT_DATA_HI_IN;  /* Get odd data */
+        ATA_PORT_CTRL_OUT = iord_h;     /* IORD = H */
+        ATA_PORT_CTRL_OUT = iord_h;     /* delay */
+        ATA_PORT_CTRL_OUT = iord_h;     /* delay */
+        ATA_PORT_CTRL_OUT = iord_h;     /* delay */
+      } while (++c);
+    } while (--block);
+  } while (count);
 
   ata_read_reg(ATA_REG_ALTSTAT);
   ata_read_reg(ATA_REG_STATUS);
@@ -308,14 +335,19 @@ DRESULT disk_read (BYTE drv, BYTE *data, DWORD sector, BYTE count) __attribute__
 
 #if _READONLY == 0
 DRESULT ata_write (BYTE drv, const BYTE *data, DWORD sector, BYTE count) {
-  BYTE s, c, iowr_l, iowr_h;
+  BYTE s, c, block, multiple, iowr_l, iowr_h;
 
   if (drv > 1 || !count) return RES_PARERR;
   if (ATA_drv_flags[drv] & STA_NOINIT) return RES_NOTRDY;
 
-  /* Issue Write Setor(s) command */
+  /* Issue Write Setor(s) or Write Multiple command */
+  multiple = (count > 1) ? ATA_drv_multiple[drv] : 1;
   ata_select_sector(drv,sector,count);
-  ATA_WRITE_CMD(ATA_drv_flags[drv] & STA_48BIT ? ATA_CMD_WRITE_EXT : ATA_CMD_WRITE);
+  if (multiple > 1)
+    c = ATA_drv_flags[drv] & STA_48BIT ? ATA_CMD_WRITE_MULTIPLE_EXT : ATA_CMD_WRITE_MULTIPLE;
+  else
+    c = ATA_drv_flags[drv] & STA_48BIT ? ATA_CMD_WRITE_EXT : ATA_CMD_WRITE;
+  ATA_WRITE_CMD(c);
 
   iowr_h = ATA_REG_DATA;
   iowr_l = ATA_REG_DATA & (BYTE)~ATA_PIN_WR;
@@ -324,14 +356,18 @@ DRESULT ata_write (BYTE drv, const BYTE *data, DWORD sector, BYTE count) {
     ATA_PORT_CTRL_OUT = ATA_REG_DATA;
     ATA_PORT_DATA_LO_DDR = 0xff;      /* bring to output */
     ATA_PORT_DATA_HI_DDR = 0xff;      /* bring to output */
-    c = 0;
-    do {
-      ATA_PORT_DATA_LO_OUT = *data++; /* Set even data */
-      ATA_PORT_DATA_HI_OUT = *data++; /* Set odd data */
-      ATA_PORT_CTRL_OUT = iowr_l;     /* IOWR = L */
-      ATA_PORT_CTRL_OUT = iowr_h;     /* IOWR = H */
-    } while (++c);
-  } while (--count);
+    block = (count < multiple) ? count : multiple;
+    count -= block;
+    do {                              /* All sectors of this data request */
+      c = 0;
+      do {
+        ATA_PORT_DATA_LO_OUT = *data++; /* Set even data */
+        ATA_PORT_DATA_HI_OUT = *data++; /* Set odd data */
+        ATA_PORT_CTRL_OUT = iowr_l;     /* IOWR = L */
+        ATA_PORT_CTRL_OUT = iowr_h;     /* IOWR = H */
+      } while (++c);
+    } while (--block);
+  } while (count);
   ATA_PORT_DATA_LO_OUT = 0xff;        /* Set D0-D15 as input */
   ATA_PORT_DATA_HI_OUT = 0xff;
   ATA_PORT_DATA_LO_DDR = 0x00;        /* bring to input */
@@ -365,7 +401,7 @@ DRESULT ata_ioctl (BYTE drv, BYTE ctrl, void *buff) {
 
   switch (ctrl) {
     case GET_SECTOR_COUNT : /* Get number of sectors on the disk (DWORD) */
-      ofs = 60; w = 2; n = 0;
+      ofs = (ATA_drv_flags[drv] & STA_48BIT) ? 100 : 60; w = 2; n = 0;
       break;
 
     case GET_SECTOR_SIZE :  /* Get sectors on the disk (WORD) */
@@ -409,17 +445,17 @@ DRESULT disk_ioctl (BYTE drv, BYTE ctrl, void *buff) __attribute__ ((weak, alias
 #endif /*  _USE_IOCTL != 0 */
 
 DRESULT ata_getinfo(BYTE drv, BYTE page, void *buffer) {
-  (void)drv;
-
   diskinfo0_t *di = buffer;
 
-  if (page != 0)
+  if (drv > 1 || page != 0)
     return RES_ERROR;
 
   ATA_WRITE_CMD(ATA_CMD_IDENTIFY);
   if (!ata_wait_data()) return RES_ERROR;
 
-  ata_read_part((BYTE *)&di->sectorcount, 60, 2);
+  /* Drives above 128GB report their full size only in words 100-103 */
+  ata_read_part((BYTE *)&di->sectorcount,
+                (ATA_drv_flags[drv] & STA_48BIT) ? 100 : 60, 2);
 
   di->validbytes = sizeof(diskinfo0_t);
   di->disktype   = DISK_TYPE_ATA;
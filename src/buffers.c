@@ -107,6 +107,24 @@ static void alloc_specific_buffer(uint8_t bufnum) {
  * pointer to the buffer structure or NULL of no buffer is free.
  */
 buffer_t *alloc_system_buffer(void) {
+  buffer_t *buf = alloc_spare_buffer();
+
+  if (buf == NULL)
+    set_error(ERROR_NO_CHANNEL);
+
+  return buf;
+}
+
+/**
+ * alloc_spare_buffer - allocate a buffer for optional system use
+ *
+ * This function allocates a buffer and marks it as used, just like
+ * alloc_system_buffer. It does not set an error if no buffer is free,
+ * so it can be used for optional features that silently fall back
+ * to a slower code path. Returns a pointer to the buffer structure
+ * or NULL if no buffer is free.
+ */
+buffer_t *alloc_spare_buffer(void) {
   uint8_t i;
 
   for (i=0;i<CONFIG_BUFFER_COUNT;i++) {
@@ -116,7 +134,6 @@ buffer_t *alloc_system_buffer(void) {
     }
   }
 
-  set_error(ERROR_NO_CHANNEL);
   return NULL;
 }
 
@@ -147,6 +147,9 @@ uint8_t callback_dummy(buffer_t *buf);
 /* Allocates a buffer for internal use */
 buffer_t *alloc_system_buffer(void);
 
+/* Allocates a buffer for internal use without setting an error on failure */
+buffer_t *alloc_spare_buffer(void);
+
 /* Allocates a buffer - returns pointer to buffer or NULL if failure */
 buffer_t *alloc_buffer(void);
 
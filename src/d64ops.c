@@ -34,6 +34,8 @@
 #include "parser.h"
 #include "progmem.h"
 #include "rtc.h"
+#include "stats.h"
+#include "timer.h"
 #include "ustring.h"
 #include "wrapops.h"
 #include "d64ops.h"
@@ -84,6 +86,9 @@
 /* used for error info only */
 #define MAX_SECTORS_PER_TRACK 40
 
+/* Time the bus must be idle before written image data is synced */
+#define IMAGE_SYNC_DELAY (HZ/2)
+
 typedef enum { BAM_BITFIELD, BAM_FREECOUNT } bamdata_t;
 
 struct {
@@ -97,6 +102,8 @@ d64_lastread_t d64_lastread;  // last read track/sector
 static buffer_t *bam_buffer;  // recently-used buffer
 static buffer_t *bam_buffer2; // secondary buffer
 static uint8_t   bam_refcount;
+static uint8_t   sync_pending;
+static tick_t    sync_deadline;
 
 /* ------------------------------------------------------------------------- */
 /*  Forward declarations                                                     */
@@ -404,7 +411,7 @@ static uint8_t bam_buffer_flush(buffer_t *buf) {
                       sector_offset(buf->pvt.bam.part,
                                     buf->pvt.bam.track,
                                     buf->pvt.bam.sector),
-                      buf->data, 256, 1);
+                      buf->data, 256, 0);
     buf->mustflush = 0;
 
     return res;
@@ -415,8 +422,14 @@ static uint8_t bam_buffer_flush(buffer_t *buf) {
 /**
  * d64_bam_commit - write BAM buffers to disk
  *
- * This function is the exported interface to force the BAM buffer
- * contents to disk. Returns 0 if successful, != 0 otherwise.
+ * This function is the exported interface to write the BAM buffer
+ * contents back into the image files. It is called at the end of
+ * every bus transaction. Sector and BAM writes into disk images are
+ * not flushed individually, adjacent sectors are combined in the
+ * sector buffer of the image file instead. The sync of the image
+ * files is deferred until the bus has been idle for IMAGE_SYNC_DELAY
+ * (see d64_sync_idle) or until d64_sync is called.
+ * Returns 0 if successful, != 0 otherwise.
  */
 uint8_t d64_bam_commit(void) {
   uint8_t res = 0;
@@ -427,6 +440,44 @@ uint8_t d64_bam_commit(void) {
   if (bam_buffer2)
     res |= bam_buffer2->cleanup(bam_buffer2);
 
+  sync_pending  = 1;
+  sync_deadline = getticks() + IMAGE_SYNC_DELAY;
+
+  return 0;
+}
+
+/**
+ * d64_sync - write back all pending changes of mounted images
+ *
+ * This function commits the BAM buffers and syncs all mounted
+ * images immediately. Returns 0 if successful, != 0 otherwise.
+ */
+uint8_t d64_sync(void) {
+  uint8_t res = d64_bam_commit();
+  uint8_t i;
+
+  sync_pending = 0;
+
+  for (i = 0; i < max_part; i++)
+    if (partition[i].fop == &d64ops)
+      res |= image_sync(i);
+
+  return res;
+}
+
+/**
+ * d64_sync_idle - sync mounted images if the bus has been idle long enough
+ *
+ * This function must be called regularly while the bus is idle.
+ * It syncs all mounted images once IMAGE_SYNC_DELAY has passed
+ * since the end of the last bus transaction. Returns 1 if the
+ * images were synced, 0 if there was nothing to do.
+ */
+uint8_t d64_sync_idle(void) {
+  if (sync_pending && time_after(getticks(), sync_deadline)) {
+    d64_sync();
+    return 1;
+  }
   return 0;
 }
 
@@ -554,6 +605,7 @@ static uint8_t move_bam_window(uint8_t part, uint8_t track, bamdata_t type, uint
        * while keeping buf2 without swapping would be better.
        */
       bam_buffer_swap();
+      stats_inc(STAT_BAM_SWAPS);
 
       /* check again, now in the other buffer */
       if (bam_buffer_match(bam_buffer, part, t, s))
@@ -1147,7 +1199,7 @@ static uint8_t d64_write(buffer_t *buf) {
                   sector_offset(buf->pvt.d64.part,
                                 buf->pvt.d64.track,
                                 buf->pvt.d64.sector),
-                  buf->data, 256, 1)) {
+                  buf->data, 256, 0)) {
     free_buffer(buf);
     return 1;
   }
@@ -1181,8 +1233,8 @@ static uint8_t d64_write_cleanup(buffer_t *buf) {
   if (t == 0)
     return 1;
 
-  /* Store data */
-  if (image_write(buf->pvt.d64.part, sector_offset(buf->pvt.d64.part,t,s), buf->data, 256, 1))
+  /* Store data, write_entry below flushes it */
+  if (image_write(buf->pvt.d64.part, sector_offset(buf->pvt.d64.part,t,s), buf->data, 256, 0))
     return 1;
 
   /* Update directory entry */
@@ -1203,6 +1255,52 @@ static uint8_t d64_write_cleanup(buffer_t *buf) {
   return 0;
 }
 
+/**
+ * d64_copy_contents - copy a file between disk images sector by sector
+ * @srcbuf: buffer of the source file, opened for reading
+ * @dstbuf: buffer of the destination file, opened for writing
+ *
+ * This function appends the remaining sectors of the source file to
+ * the destination file if both are files in disk images and both
+ * buffers are at the start of a sector. The chain sectors of the source
+ * are read straight into the destination buffer and stored with the
+ * usual write callback, so the data is not moved around byte-wise and
+ * the BAM changes stay in the BAM buffer until the next commit.
+ * Returns 0 if successful, 1 if an error occured or 2 if the buffers
+ * do not qualify and the data must be copied by the caller.
+ */
+uint8_t d64_copy_contents(buffer_t *srcbuf, buffer_t *dstbuf) {
+  uint8_t t, s;
+
+  if (srcbuf->refill != d64_read || dstbuf->refill != d64_write ||
+      srcbuf->position != 2 || dstbuf->position != 2)
+    return 2;
+
+  memcpy(dstbuf->data, srcbuf->data, 256);
+  mark_buffer_dirty(dstbuf);
+
+  while (dstbuf->data[0] != 0) {
+    /* Store the full sector, this also allocates the next one */
+    t = dstbuf->data[0];
+    s = dstbuf->data[1];
+    dstbuf->lastused = 255;
+    if (dstbuf->refill(dstbuf))
+      return 1;
+
+    if (checked_read(srcbuf->pvt.d64.part, t, s, dstbuf->data, 256, ERROR_ILLEGAL_TS_LINK))
+      return 1;
+
+    mark_buffer_dirty(dstbuf);
+  }
+
+  /* Keep the final sector for the cleanup callback */
+  dstbuf->lastused = dstbuf->data[1];
+  dstbuf->position = dstbuf->lastused + 1;
+  srcbuf->position = srcbuf->lastused;
+
+  return 0;
+}
+
 
 /* ------------------------------------------------------------------------- */
 /*  fileops-API                                                              */
@@ -1597,7 +1695,7 @@ static void d64_write_sector(buffer_t *buf, uint8_t part, uint8_t track, uint8_t
       sector >= sectors_per_track(part, track)) {
     set_error_ts(ERROR_ILLEGAL_TS_COMMAND,track,sector);
   } else
-    image_write(part, sector_offset(part,track,sector), buf->data, 256, 1);
+    image_write(part, sector_offset(part,track,sector), buf->data, 256, 0);
 }
 
 static void d64_rename(path_t *path, cbmdirent_t *dent, uint8_t *newname) {
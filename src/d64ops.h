@@ -66,6 +66,13 @@ void    d64_unmount(uint8_t part);
 /* commit BAM buffer contents to storage medium */
 uint8_t d64_bam_commit(void);
 
+/* write back pending image changes, immediately or after an idle delay */
+uint8_t d64_sync(void);
+uint8_t d64_sync_idle(void);
+
+/* copy a file between disk images without the generic copy loop */
+uint8_t d64_copy_contents(buffer_t *srcbuf, buffer_t *dstbuf);
+
 void d64_raw_directory(path_t *path, buffer_t *buf);
 void d64_invalidate(void);
 
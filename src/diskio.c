@@ -162,5 +162,15 @@ DRESULT disk_getinfo(BYTE drv, BYTE page, void *buffer) {
   }
 }
 
+#ifdef CONFIG_SD_WRITE_QUEUE
+DRESULT disk_flush(void) {
+  return sd_flush();
+}
+
+uint8_t disk_flush_step(void) {
+  return sd_flush_step();
+}
+#endif
+
 
 #endif
@@ -77,6 +77,15 @@ DRESULT disk_write (BYTE, const BYTE*, DWORD, BYTE);
 #define disk_ioctl(a,b,c) RES_OK
 DRESULT disk_getinfo(BYTE drv, BYTE page, void *buffer);
 
+#ifdef CONFIG_SD_WRITE_QUEUE
+/* Write back the sectors in the write queue, all or just one */
+DRESULT disk_flush(void);
+uint8_t disk_flush_step(void);
+#else
+static inline DRESULT disk_flush(void) { return RES_OK; }
+static inline uint8_t disk_flush_step(void) { return 0; }
+#endif
+
 void disk_init(void);
 
 /* Will be set to DISK_ERROR if any access on the card fails */
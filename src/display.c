@@ -32,6 +32,7 @@
 #include "iec.h"
 #include "parser.h"
 #include "progmem.h"
+#include "timer.h"
 #include "ustring.h"
 #include "utils.h"
 #include "display.h"
@@ -56,56 +57,309 @@ static uint8_t displaybuffer[CONFIG_DISPLAY_BUFFER_SIZE];
 
 uint8_t display_found;
 
+/* Set if the display supports windowed menus */
+static uint8_t display_windowed;
+
+/* Status messages waiting to be sent to the display */
+typedef struct {
+  uint8_t cmd;
+  uint8_t len;
+  uint8_t data[CONFIG_DISPLAY_BUFFER_SIZE];
+} display_msg_t;
+
+static display_msg_t msgqueue[CONFIG_DISPLAY_QUEUE_SIZE];
+static uint8_t msgqueue_head, msgqueue_count;
+
+/* Time a busy display may take to accept a message */
+#define DISPLAY_TIMEOUT (HZ/10)
+
+/**
+ * send_wait - send a command to the display, retrying while it is busy
+ * @cmd: display command
+ * @len: length of buf
+ * @buf: command data
+ *
+ * This function sends a command to the display and repeats it while
+ * the display does not acknowledge. If it was not accepted within
+ * DISPLAY_TIMEOUT, the display is considered lost: display_found is
+ * cleared and all queued messages are dropped. Returns 0 if the
+ * command was sent, != 0 if the display was lost.
+ */
+static uint8_t send_wait(uint8_t cmd, uint8_t len, const void *buf) {
+  tick_t timeout = getticks() + DISPLAY_TIMEOUT;
+
+  while (i2c_write_registers(DISPLAY_I2C_ADDR, cmd, len, buf)) {
+    if (time_after(getticks(), timeout)) {
+      display_found  = 0;
+      msgqueue_count = 0;
+      return 1;
+    }
+  }
+
+  return 0;
+}
+
+/**
+ * send_queued - send the oldest queued message
+ * @wait: retry while the display is busy
+ *
+ * This function tries to send the oldest message in the queue to the
+ * display and removes it from the queue if successful. With @wait set
+ * it retries until the message was sent or the display was lost.
+ * Returns 0 if the message was sent, != 0 otherwise.
+ */
+static uint8_t send_queued(uint8_t wait) {
+  display_msg_t *msg = &msgqueue[msgqueue_head];
+
+  if (wait) {
+    if (send_wait(msg->cmd, msg->len, msg->data))
+      return 1;
+  } else {
+    if (i2c_write_registers(DISPLAY_I2C_ADDR, msg->cmd, msg->len, msg->data))
+      return 1;
+  }
+
+  msgqueue_head = (msgqueue_head + 1) % CONFIG_DISPLAY_QUEUE_SIZE;
+  msgqueue_count--;
+  return 0;
+}
+
+/**
+ * queue_msg - add a status message to the queue
+ * @cmd       : display command
+ * @prefixed  : flag if prefixbyte should be sent before buffer
+ * @prefixbyte: prefix byte, usually a partition number
+ * @len       : length of buffer
+ * @buffer    : message data
+ *
+ * This function stores a message for the display in the queue.
+ * The queue keeps only the latest message of each command (and
+ * prefix byte) because the display only shows the latest one anyway.
+ * An older message of the same type is removed and the new one is
+ * always added at the end, so the messages are still sent in the
+ * order they were created and the display ends with the newest state.
+ * If the queue is full, the oldest message is sent first.
+ */
+static void queue_msg(uint8_t cmd, uint8_t prefixed, uint8_t prefixbyte,
+                      uint8_t len, const uint8_t *buffer) {
+  display_msg_t *msg;
+  uint8_t i, idx, next;
+
+  if (!display_found)
+    return;
+
+  /* Remove an older message of the same type, close the gap */
+  for (i = 0; i < msgqueue_count; i++) {
+    idx = (msgqueue_head + i) % CONFIG_DISPLAY_QUEUE_SIZE;
+    msg = &msgqueue[idx];
+    if (msg->cmd == cmd && (!prefixed || msg->data[0] == prefixbyte)) {
+      for (i++; i < msgqueue_count; i++) {
+        next = (msgqueue_head + i) % CONFIG_DISPLAY_QUEUE_SIZE;
+        msgqueue[idx] = msgqueue[next];
+        idx = next;
+      }
+      msgqueue_count--;
+      break;
+    }
+  }
+
+  if (msgqueue_count == CONFIG_DISPLAY_QUEUE_SIZE)
+    if (send_queued(1))
+      /* the display was lost */
+      return;
+
+  idx = (msgqueue_head + msgqueue_count) % CONFIG_DISPLAY_QUEUE_SIZE;
+  msg = &msgqueue[idx];
+  msgqueue_count++;
+
+  msg->cmd = cmd;
+  msg->len = 0;
+  if (prefixed)
+    msg->data[msg->len++] = prefixbyte;
+  len = min(sizeof(msg->data) - msg->len, (size_t)len);
+  memcpy(msg->data + msg->len, buffer, len);
+  msg->len += len;
+}
+
+/**
+ * display_queue_run - send one queued message to the display
+ *
+ * This function is called while the bus is idle. It returns 1 if a
+ * message was sent or 0 if the queue is empty or the display is busy.
+ */
+uint8_t display_queue_run(void) {
+  if (msgqueue_count == 0)
+    return 0;
+
+  return !send_queued(0);
+}
+
+/**
+ * display_queue_flush - send all queued messages to the display
+ *
+ * This function waits until all queued messages have been sent
+ * or the display was lost.
+ */
+static void display_queue_flush(void) {
+  while (msgqueue_count)
+    send_queued(1);
+}
+
 void display_send_prefixed(uint8_t cmd, uint8_t prefixbyte, uint8_t len, const uint8_t *buffer) {
-  displaybuffer[0] = prefixbyte;
-  memcpy(displaybuffer+1, buffer, min(sizeof(displaybuffer)-1, (size_t)len));
-  i2c_write_registers(DISPLAY_I2C_ADDR, cmd, min((size_t)len+1, sizeof(displaybuffer)), displaybuffer);
+  queue_msg(cmd, 1, prefixbyte, len, buffer);
+}
+
+void display_queue_cmd(uint8_t cmd, uint8_t len, const void *buf) {
+  queue_msg(cmd, 0, 0, len, buf);
+}
+
+/* Directory iterator for the change directory menu */
+static dh_t     menu_dh;
+static path_t   menu_path;
+static uint16_t menu_dhpos;
+
+/**
+ * menu_rewind - restart the directory iterator
+ *
+ * Returns 0 if successful, != 0 on error.
+ */
+static uint8_t menu_rewind(void) {
+  menu_dhpos = 0;
+  return opendir(&menu_dh, &menu_path);
+}
+
+/**
+ * menu_nextdir - read the next entry for the change directory menu
+ * @dent: pointer to the directory entry
+ *
+ * This function reads the next directory or image file from the
+ * directory iterator. Returns 0 if successful, -1 at the end of the
+ * directory and 1 on error.
+ */
+static int8_t menu_nextdir(cbmdirent_t *dent) {
+  int8_t res;
+
+  while ((res = readdir(&menu_dh, dent)) == 0) {
+    /* Skip hidden files and only add image files on FAT */
+    if (dent->typeflags & FLAG_HIDDEN)
+      continue;
+
+    if ((dent->typeflags & TYPE_MASK) == TYPE_DIR ||
+        (dent->opstype == OPSTYPE_FAT &&
+         check_imageext(dent->pvt.fat.realname) != IMG_UNKNOWN)) {
+      menu_dhpos++;
+      return 0;
+    }
+  }
+  return res;
+}
+
+/**
+ * menu_send_window - send a part of the change directory menu
+ * @start: number of the first entry
+ *
+ * This function sends up to DISPLAY_MENU_WINDOW entries of the
+ * change directory menu to the display, starting at entry start.
+ * Entry 0 is "Cancel", entry 1 the parent directory.
+ */
+static void menu_send_window(uint16_t start) {
+  cbmdirent_t dent;
+  uint16_t entry;
+  uint8_t i;
+
+  displaybuffer[0] = start & 0xff;
+  displaybuffer[1] = start >> 8;
+  display_send_cmd(DISPLAY_MENU_SETWINDOW, 2, displaybuffer);
+
+  for (i = 0; i < DISPLAY_MENU_WINDOW; i++) {
+    entry = start + i;
+
+    if (entry == 0) {
+      ustrcpy_P(displaybuffer,PSTR("\xc3""ANCEL"));
+      display_menu_add(displaybuffer);
+    } else if (entry == 1) {
+      displaybuffer[0] = '_';
+      displaybuffer[1] = 0;
+      display_menu_add(displaybuffer);
+    } else {
+      /* seek to the entry, rewind if it was passed already */
+      entry -= 2;
+      if (menu_dhpos > entry && menu_rewind())
+        return;
+
+      while (menu_dhpos <= entry)
+        if (menu_nextdir(&dent))
+          return;
+
+      display_menu_add(dent.name);
+    }
+  }
 }
 
 static void menu_chdir(void) {
   cbmdirent_t dent;
-  dh_t    dh;
-  path_t  path;
   int8_t  res;
 
   menustate = MENU_CHDIR;
   display_menu_reset();
-  ustrcpy_P(displaybuffer,PSTR("\xc3""ANCEL"));
-  display_menu_add(displaybuffer);
-
-  displaybuffer[0] = '_';
-  displaybuffer[1] = 0;
-  display_menu_add(displaybuffer);
 
-  path.part = current_part;
-  path.dir  = partition[current_part].current_dir;
+  menu_path.part = current_part;
+  menu_path.dir  = partition[current_part].current_dir;
 
-  if (opendir(&dh, &path)) {
+  if (menu_rewind()) {
     menustate = MENU_NONE;
     return;
   }
 
-  while (1) {
-    res = readdir(&dh, &dent);
+  if (display_windowed) {
+    /* Count the entries, they are sent when the display asks for them */
+    while ((res = menu_nextdir(&dent)) == 0) ;
+  } else {
+    /* Older displays need the complete menu before it is shown */
+    ustrcpy_P(displaybuffer,PSTR("\xc3""ANCEL"));
+    display_menu_add(displaybuffer);
 
-    if (res > 0)
-      return;
-    if (res < 0)
-      break;
+    displaybuffer[0] = '_';
+    displaybuffer[1] = 0;
+    display_menu_add(displaybuffer);
 
-    /* Skip hidden files and only add image files on FAT */
-    if (!(dent.typeflags & FLAG_HIDDEN)) {
-      if ((dent.typeflags & TYPE_MASK) == TYPE_DIR) {
-        display_menu_add(dent.name);
-      } else if (dent.opstype == OPSTYPE_FAT &&
-                 check_imageext(dent.pvt.fat.realname) != IMG_UNKNOWN) {
-        display_menu_add(dent.name);
-      }
-    }
+    while ((res = menu_nextdir(&dent)) == 0)
+      display_menu_add(dent.name);
+  }
+
+  if (res > 0) {
+    menustate = MENU_NONE;
+    return;
+  }
+
+  if (display_windowed) {
+    displaybuffer[0] = (menu_dhpos + 2) & 0xff;
+    displaybuffer[1] = (menu_dhpos + 2) >> 8;
+    display_send_cmd(DISPLAY_MENU_SETSIZE, 2, displaybuffer);
+
+    menu_send_window(0);
   }
   display_menu_show(0);
 }
 
+/**
+ * display_menu_invalidate - forget the directory of the change directory menu
+ *
+ * This function must be called when the file systems are mounted again
+ * or an image is mounted. The directory handle of the change directory
+ * menu is cleared and the menu is closed if it is shown, its entries
+ * no longer match the current directory.
+ */
+void display_menu_invalidate(void) {
+  memset(&menu_dh, 0, sizeof(menu_dh));
+  menu_dhpos = 0;
+
+  if (menustate == MENU_CHDIR) {
+    menustate = MENU_NONE;
+    display_menu_reset();
+  }
+}
+
 static void menu_chaddr(void) {
   uint8_t i;
 
@@ -171,11 +425,26 @@ void display_service(void) {
     menustate = MENU_NONE;
     display_address(device_address);
   } else if (menustate == MENU_CHDIR) {
-    /* New directory selected */
-    uint8_t sel = i2c_read_register(DISPLAY_I2C_ADDR, DISPLAY_MENU_GETSELECTION);
+    uint16_t sel;
     path_t path;
     cbmdirent_t dent;
 
+    if (display_windowed) {
+      /* The display may ask for more entries of the menu */
+      if (i2c_read_registers(DISPLAY_I2C_ADDR, DISPLAY_MENU_GETREQUEST, 3, displaybuffer))
+        return;
+
+      if (displaybuffer[0]) {
+        menu_send_window(displaybuffer[1] | (displaybuffer[2] << 8));
+        return;
+      }
+    }
+
+    /* New directory selected, older displays send 0 as high byte */
+    if (i2c_read_registers(DISPLAY_I2C_ADDR, DISPLAY_MENU_GETSELECTION, 2, displaybuffer))
+      return;
+
+    sel = displaybuffer[0] | (displaybuffer[1] << 8);
     menustate = MENU_NONE;
     if (sel == 0)
       /* Cancel */
@@ -203,20 +472,46 @@ void display_service(void) {
 
 
 void display_send_cmd(uint8_t cmd, uint8_t len, const void *buf) {
-  if (display_found)
-    /* repeat until successful - the display may be busy */
-    while (i2c_write_registers(DISPLAY_I2C_ADDR, cmd, len, buf)) ;
+  if (display_found) {
+    /* keep the order of queued messages and commands */
+    display_queue_flush();
+
+    /* the display may have been lost while flushing the queue */
+    if (display_found)
+      send_wait(cmd, len, buf);
+  }
 }
 
 
 void display_send_cmd_byte(uint8_t cmd, uint8_t val) {
-  display_send_cmd(cmd, 1, &val);
+  display_queue_cmd(cmd, 1, &val);
 }
 
 
+/**
+ * check_windowed - check if the display supports windowed menus
+ *
+ * Displays that do not know DISPLAY_GETCAPS return whatever is left
+ * in their transmit buffer, so the reply is only accepted if it starts
+ * with DISPLAY_CAPS_MAGIC and the flags are followed by their inverse.
+ * Returns 1 if windowed menus are supported, 0 otherwise.
+ */
+static uint8_t check_windowed(void) {
+  uint8_t caps[3];
+
+  if (i2c_read_registers(DISPLAY_I2C_ADDR, DISPLAY_GETCAPS, 3, caps))
+    return 0;
+
+  return caps[0] == DISPLAY_CAPS_MAGIC &&
+         (caps[1] ^ caps[2]) == 0xff &&
+         (caps[1] & DISPLAY_CAP_WINDOWED);
+}
+
 uint8_t display_init(uint8_t len, uint8_t *message) {
   display_intrq_init();
   display_found = !i2c_write_registers(DISPLAY_I2C_ADDR, DISPLAY_INIT, len, message);
+  if (display_found)
+    display_windowed = check_windowed();
   return display_found;
 }
 
@@ -226,7 +521,7 @@ void display_filename_write(uint8_t part, uint8_t len, const unsigned char *buf)
 }
 
 void display_menu_show(uint8_t start) {
-  display_send_cmd_byte(DISPLAY_MENU_SHOW, start);
+  display_send_cmd(DISPLAY_MENU_SHOW, 1, &start);
 }
 
 
@@ -37,6 +37,8 @@ uint8_t display_init(uint8_t len, uint8_t *message);
 void display_service(void);
 void display_send_cmd(uint8_t cmd, uint8_t len, const void *buf);
 void display_send_cmd_byte(uint8_t cmd, uint8_t val);
+void display_queue_cmd(uint8_t cmd, uint8_t len, const void *buf);
+uint8_t display_queue_run(void);
 
 void display_filename_write(uint8_t part, uint8_t len, const unsigned char* buf);
 void display_menu_show(uint8_t start);
@@ -44,6 +46,7 @@ void display_address(uint8_t dev);
 void display_current_part(uint8_t part);
 void display_menu_add(const unsigned char* string);
 void display_menu_reset(void);
+void display_menu_invalidate(void);
 void display_current_directory(uint8_t part, const unsigned char* name);
 
 #else // CONFIG_REMOTE_DISPLAY
@@ -54,6 +57,8 @@ void display_current_directory(uint8_t part, const unsigned char* name);
 # define display_service()              do {} while (0)
 # define display_send_cmd(cmd,len,buf)  do {} while (0)
 # define display_send_cmd_byte(cmd,v)   do {} while (0)
+# define display_queue_cmd(cmd,len,buf) do {} while (0)
+# define display_queue_run()            0
 
 # define display_filename_write(a,b,c)  do {} while (0)
 # define display_menu_show(a)           do {} while (0)
@@ -61,6 +66,7 @@ void display_current_directory(uint8_t part, const unsigned char* name);
 # define display_current_part(a)        do {} while (0)
 # define display_menu_add(a)            do {} while (0)
 # define display_menu_reset()           do {} while (0)
+# define display_menu_invalidate()      do {} while (0)
 # define display_current_directory(a,b) do {} while (0)
 
 #endif // CONFIG_REMOTE_DISPLAY
@@ -82,10 +88,23 @@ enum display_commands {
   DISPLAY_MENU_SHOW,         // uint8_t startentry
   DISPLAY_MENU_GETSELECTION, // returns the number of the selected menu entry
   DISPLAY_MENU_GETENTRY,     // returns the text of the selected menu entry
+  DISPLAY_MENU_SETSIZE,      // uint16_t number of entries of a windowed menu
+  DISPLAY_MENU_SETWINDOW,    // uint16_t number of the next entry added
+  DISPLAY_MENU_GETREQUEST,   // returns flag + uint16_t first entry requested
+  DISPLAY_GETCAPS,           // returns magic, capability flags, inverted flags
 };
 
+/* First byte of the DISPLAY_GETCAPS reply */
+#define DISPLAY_CAPS_MAGIC   0xd5
+
+/* Capability flags */
+#define DISPLAY_CAP_WINDOWED 0x01  // windowed menus (SETSIZE/SETWINDOW/GETREQUEST)
+
+/* Number of entries sent for a request of a windowed menu */
+#define DISPLAY_MENU_WINDOW 16
+
 #define display_filename_read(part,len,buf)     display_send_prefixed(DISPLAY_FILENAME_READ,part,len,buf)
-#define display_doscommand(len,buf)             display_send_cmd(DISPLAY_DOSCOMMAND,len,buf)
-#define display_errorchannel(len,buf)           display_send_cmd(DISPLAY_ERRORCHANNEL,len,buf)
+#define display_doscommand(len,buf)             display_queue_cmd(DISPLAY_DOSCOMMAND,len,buf)
+#define display_errorchannel(len,buf)           display_queue_cmd(DISPLAY_ERRORCHANNEL,len,buf)
 
 #endif // DISPLAY_H
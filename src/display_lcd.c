@@ -67,9 +67,28 @@ void lcd_clrline(int line)
 
 void lcd_cmdseq(char * cmdseq)
 {
+	uint8_t cmd = cmdseq[0];
+
 	if (lcd_controller_type() != 0)
 	{
-		lcd_command(cmdseq[0]);
+		/* clear and cursor moves must be applied to the frame buffer */
+		if (cmd == (1<<LCD_CLR))
+			lcd_clrscr();
+		else if (cmd == (1<<LCD_HOME))
+			lcd_home();
+		else if (cmd & (1<<LCD_DDRAM))
+			lcd_gotoaddr(cmd & 0x7f);
+		else if (cmd & (1<<LCD_CGRAM))
+		{
+			/* character definitions bypass the frame buffer */
+			lcd_flush();
+			lcd_command(cmd);
+			while (*++cmdseq)
+				lcd_data(*cmdseq);
+			return;
+		}
+		else
+			lcd_command(cmd);
 		lcd_puts(cmdseq+1);
 	}
 }
@@ -110,6 +129,7 @@ void lcd_eee()
 		{
 		  lcd_putc( pgm_read_byte(progmem_s++) );
 		}
+		lcd_flush();
 	}
 #endif
 }
@@ -131,6 +151,7 @@ void lcd_logo()
 		lcd_puts_p(PSTR("Commodore"));
 		lcd_gotoxy(4,1);
 		lcd_puts_p(PSTR("never dies!"));
+		lcd_flush();
 	}
 }
 
@@ -45,9 +45,11 @@
 #include "iec.h"
 #include "led.h"
 #include "parser.h"
+#include "profile.h"
 #include "system.h"
 #include "time.h"
 #include "rtc.h"
+#include "stats.h"
 #include "uart.h"
 #include "ustring.h"
 #include "utils.h"
@@ -381,25 +383,6 @@ static uint8_t loader_buffer[CONFIG_CAPTURE_BUFFER_SIZE];
 static uint8_t *loader_ptr = loader_buffer;
 static uint8_t capture_count = 0;
 
-/* Convert byte to two-character hex string */
-static uint8_t *byte_to_hex(uint8_t num, uint8_t *str) {
-  uint8_t tmp;
-
-  tmp = (num & 0xf0) >> 4;
-  if (tmp < 10)
-    *str++ = '0' + tmp;
-  else
-    *str++ = 'a' + tmp - 10;
-
-  tmp = num & 0x0f;
-  if (tmp < 10)
-    *str++ = '0' + tmp;
-  else
-    *str++ = 'a' + tmp - 10;
-
-  return str;
-}
-
 /* Copy command to capture buffer */
 static void dump_command(void) {
   if (loader_ptr - loader_buffer + command_length + 2+1 < CONFIG_CAPTURE_BUFFER_SIZE) {
@@ -795,6 +778,125 @@ static void parse_block(void) {
 /* ---------- */
 /*  C - Copy  */
 /* ---------- */
+
+/**
+ * copy_contents - copy the contents of an open file
+ * @srcbuf: buffer of the opened source file
+ * @dstbuf: buffer of the opened destination file
+ * @type  : file type of the destination file
+ *
+ * This function appends the remaining data of the source file to the
+ * destination file. Files in disk images are copied sector by sector
+ * if possible. Returns 0 if successful or 1 if an error occured.
+ */
+static uint8_t copy_contents(buffer_t *srcbuf, buffer_t *dstbuf, uint8_t type) {
+  if (type != TYPE_REL) {
+    uint8_t res = d64_copy_contents(srcbuf, dstbuf);
+
+    if (res != 2)
+      return res;
+  }
+
+  while (1) {
+    uint8_t tocopy;
+
+    if (type == TYPE_REL)
+      tocopy = srcbuf->recordlen;
+    else
+      tocopy = 256-dstbuf->position;
+
+    if (tocopy > (srcbuf->lastused - srcbuf->position+1))
+      tocopy = srcbuf->lastused - srcbuf->position + 1;
+
+    if (tocopy > 256-dstbuf->position)
+      tocopy = 256-dstbuf->position;
+
+    memcpy(dstbuf->data + dstbuf->position,
+           srcbuf->data + srcbuf->position,
+           tocopy);
+    mark_buffer_dirty(dstbuf);
+    srcbuf->position += tocopy-1;  /* add 1 less, simplifies the test later */
+    dstbuf->position += tocopy;
+    dstbuf->lastused  = dstbuf->position-1;
+
+    /* End if we just copied the last data block */
+    if (srcbuf->sendeoi && srcbuf->position == srcbuf->lastused)
+      return 0;
+
+    /* Refill the buffers if required */
+    if (srcbuf->recordlen || srcbuf->position++ == srcbuf->lastused)
+      if (srcbuf->refill(srcbuf))
+        return 1;
+
+    if (dstbuf->recordlen || dstbuf->position == 0)
+      if (dstbuf->refill(dstbuf))
+        return 1;
+  }
+}
+
+/**
+ * copy_all - copy all matching files into a directory
+ * @dstpath: path of the destination directory
+ * @srcname: source path and pattern
+ *
+ * This function copies every SEQ, PRG and USR file matching srcname
+ * into the directory dstpath, keeping their names and types. It can
+ * be used to extract the contents of a disk image into a FAT directory.
+ */
+static void copy_all(path_t *dstpath, uint8_t *srcname) {
+  path_t srcpath;
+  dh_t dh;
+  cbmdirent_t dent, dstdent;
+  buffer_t *srcbuf, *dstbuf;
+  uint8_t type;
+  int8_t res;
+
+  if (parse_path(srcname, &srcpath, &srcname, 0))
+    return;
+
+  if (*srcname == 0)
+    srcname = NULL;
+
+  if (opendir(&dh, &srcpath))
+    return;
+
+  while (1) {
+    res = next_match(&dh, srcname, NULL, NULL, FLAG_HIDDEN, &dent);
+    if (res < 0)
+      break;
+    if (res > 0)
+      return;
+
+    type = dent.typeflags & TYPE_MASK;
+    if (type != TYPE_SEQ && type != TYPE_PRG && type != TYPE_USR)
+      continue;
+
+    srcbuf = alloc_buffer();
+    dstbuf = alloc_buffer();
+    if (srcbuf == NULL || dstbuf == NULL) {
+      free_buffer(srcbuf);
+      return;
+    }
+
+    open_read(&srcpath, &dent, srcbuf);
+    if (current_error == 0) {
+      memset(&dstdent, 0, sizeof(dstdent));
+      memcpy(dstdent.name, dent.name, CBM_NAME_LENGTH);
+      open_write(dstpath, &dstdent, type, dstbuf, 0);
+
+      if (current_error == 0)
+        copy_contents(srcbuf, dstbuf, type);
+    }
+
+    srcbuf->cleanup(srcbuf);
+    free_buffer(srcbuf);
+    cleanup_and_free_buffer(dstbuf);
+
+    if (current_error != 0)
+      return;
+  }
+}
+
 static void parse_copy(void) {
   path_t srcpath,dstpath;
   uint8_t *srcname,*dstname,*tmp;
@@ -817,6 +919,13 @@ static void parse_copy(void) {
   if (parse_path(command_buffer+1, &dstpath, &dstname, 0))
     return;
 
+  /* Copy all matching files into a directory */
+  if (dstname[0] == '*' && dstname[1] == 0) {
+    set_error(ERROR_OK);
+    copy_all(&dstpath, srcname);
+    return;
+  }
+
   if (ustrlen(dstname) == 0) {
     set_error(ERROR_SYNTAX_NONAME);
     return;
@@ -886,41 +995,8 @@ static void parse_copy(void) {
         open_write(&dstpath, &dent, savedtype, dstbuf, 0);
     }
 
-    while (1) {
-      uint8_t tocopy;
-
-      if (savedtype == TYPE_REL)
-        tocopy = srcbuf->recordlen;
-      else
-        tocopy = 256-dstbuf->position;
-
-      if (tocopy > (srcbuf->lastused - srcbuf->position+1))
-        tocopy = srcbuf->lastused - srcbuf->position + 1;
-
-      if (tocopy > 256-dstbuf->position)
-        tocopy = 256-dstbuf->position;
-
-      memcpy(dstbuf->data + dstbuf->position,
-             srcbuf->data + srcbuf->position,
-             tocopy);
-      mark_buffer_dirty(dstbuf);
-      srcbuf->position += tocopy-1;  /* add 1 less, simplifies the test later */
-      dstbuf->position += tocopy;
-      dstbuf->lastused  = dstbuf->position-1;
-
-      /* End if we just copied the last data block */
-      if (srcbuf->sendeoi && srcbuf->position == srcbuf->lastused)
-        break;
-
-      /* Refill the buffers if required */
-      if (srcbuf->recordlen || srcbuf->position++ == srcbuf->lastused)
-        if (srcbuf->refill(srcbuf))
-          goto cleanup;
-
-      if (dstbuf->recordlen || dstbuf->position == 0)
-        if (dstbuf->refill(dstbuf))
-          goto cleanup;
-    }
+    if (copy_contents(srcbuf, dstbuf, savedtype))
+      goto cleanup;
 
     /* Close current source file */
     /* Free and reallocate the buffer. This is required because most of the  */
@@ -1164,8 +1240,12 @@ static void parse_getpartition(void) {
 static void parse_initialize(void) {
   if (disk_state != DISK_OK)
     set_error_ts(ERROR_READ_NOSYNC,18,0);
-  else
+  else {
     free_multiple_buffers(FMB_USER_CLEAN);
+    d64_sync();
+    if (disk_flush() != RES_OK)
+      set_error(ERROR_WRITE_VERIFY);
+  }
 }
 
 
@@ -1333,6 +1413,7 @@ static void handle_memwrite(void) {
   /* Set RX/TX function pointers */
   if (loader != FL_NONE) {
     detected_loader = loader;
+    stats_inc(STAT_LOADERS);
 
 #ifdef CONFIG_HAVE_IEC
     uint8_t index;
@@ -1904,11 +1985,16 @@ static void parse_user(void) {
     /* Reset - technically hard-reset */
     /* Faked because Ultima 5 sends UJ. */
     free_multiple_buffers(FMB_USER);
-    set_error(ERROR_DOSVERSION);
+    d64_sync();
+    if (disk_flush() != RES_OK)
+      set_error(ERROR_WRITE_VERIFY);
+    else
+      set_error(ERROR_DOSVERSION);
     break;
 
   case 202: /* Shift-J */
     /* The real hard reset command */
+    (void)disk_flush();
     system_reset();
     break;
 
@@ -2125,6 +2211,38 @@ static void parse_xcommand(void) {
     }
     break;
 
+#ifdef CONFIG_PROFILING
+  case 'P':
+    /* Profiling counters */
+    str = command_buffer + 2;
+    if (*str == '-') {
+      profile_reset();
+      break;
+    }
+    num = parse_number(&str);
+    if (num < PROF_COUNT)
+      set_error_ts(ERROR_STATUS, num, 2);
+    else
+      set_error(ERROR_SYNTAX_UNKNOWN);
+    break;
+#endif
+
+#ifdef CONFIG_STATISTICS
+  case 'N':
+    /* Statistics counters */
+    str = command_buffer + 2;
+    if (*str == '-') {
+      stats_reset();
+      break;
+    }
+    num = parse_number(&str);
+    if (num < STAT_PAGES)
+      set_error_ts(ERROR_STATUS, num, 3);
+    else
+      set_error(ERROR_SYNTAX_UNKNOWN);
+    break;
+#endif
+
 #ifdef CONFIG_STACK_TRACKING
   case '?':
     /* Output the largest stack size seen */
@@ -2194,12 +2312,15 @@ void parse_doscommand(void) {
     return;
   }
 
+  profile_enter(PROF_DOSCMD);
+
   /* Send command to display */
   display_doscommand(command_length, command_buffer);
 
   /* MD/CD/RD clash with other commands, so they're checked first */
   if (command_buffer[0] != 'X' && command_buffer[1] == 'D') {
     parse_dircommand();
+    profile_exit(PROF_DOSCMD);
     return;
   }
 
@@ -2281,4 +2402,5 @@ void parse_doscommand(void) {
     set_error(ERROR_SYNTAX_UNKNOWN);
     break;
   }
+  profile_exit(PROF_DOSCMD);
 }
@@ -23,6 +23,7 @@
 
 */
 
+#include <stddef.h>
 #include <string.h>
 #include "config.h"
 #include "arch-eeprom.h"
@@ -50,6 +51,7 @@ uint8_t rom_filename[ROM_NAME_LENGTH+1];
  * @drvflags1  : 16 bits of drv mappings, organized as 4 nybbles.
  * @imagedirs  : Disk images-as-directory mode
  * @romname    : M-R rom emulation file name (zero-padded, but not terminated)
+ * @sdspeed    : SPI clock settings of SD cards, checked per entry
  *
  * This is the data structure for the contents of the EEPROM.
  *
@@ -69,8 +71,20 @@ static EEMEM struct {
   uint16_t drvconfig1;
   uint8_t  imagedirs;
   uint8_t  romname[ROM_NAME_LENGTH];
+  sdspeed_t sdspeed[SDSPEED_ENTRIES];
 } __attribute__((packed)) storedconfig;
 
+/* calculate the checksum over the first size bytes of the EEPROM */
+static uint8_t config_checksum(uint16_t size) {
+  uint_fast16_t i;
+  uint8_t checksum = 0;
+
+  for (i=2; i<size; i++)
+    checksum += eeprom_read_byte((uint8_t *)i);
+
+  return checksum;
+}
+
 /**
  * read_configuration - reads configuration from EEPROM
  *
@@ -79,8 +93,8 @@ static EEMEM struct {
  * be changed.
  */
 void read_configuration(void) {
-  uint_fast16_t i,size;
-  uint8_t checksum, tmp;
+  uint_fast16_t size;
+  uint8_t tmp;
 
   /* Set default values */
   globalflags         |= POSTMATCH;            /* Post-* matching enabled */
@@ -102,13 +116,8 @@ void read_configuration(void) {
     return;
   }
 
-  /* Calculate checksum of EEPROM contents */
-  checksum = 0;
-  for (i=2; i<size; i++)
-    checksum += eeprom_read_byte((uint8_t *)i);
-
   /* Abort if the checksum doesn't match */
-  if (checksum != eeprom_read_byte(&storedconfig.checksum)) {
+  if (config_checksum(size) != eeprom_read_byte(&storedconfig.checksum)) {
     eeprom_safety();
     return;
   }
@@ -155,9 +164,6 @@ void read_configuration(void) {
  * This function stores the current configuration values to the EEPROM.
  */
 void write_configuration(void) {
-  uint_fast16_t i;
-  uint8_t checksum;
-
   /* Write configuration to EEPROM */
   eeprom_write_word(&storedconfig.structsize, sizeof(storedconfig));
   eeprom_write_byte(&storedconfig.global_flags,
@@ -174,15 +180,64 @@ void write_configuration(void) {
   memset(rom_filename+ustrlen(rom_filename), 0, sizeof(rom_filename)-ustrlen(rom_filename));
   eeprom_write_block(rom_filename, &storedconfig.romname, ROM_NAME_LENGTH);
 
-  /* Calculate checksum over EEPROM contents */
-  checksum = 0;
-  for (i=2;i<sizeof(storedconfig);i++)
-    checksum += eeprom_read_byte((uint8_t *) i);
-
-  /* Store checksum to EEPROM */
-  eeprom_write_byte(&storedconfig.checksum, checksum);
+  /* Store checksum over EEPROM contents */
+  eeprom_write_byte(&storedconfig.checksum, config_checksum(sizeof(storedconfig)));
 
   /* Prevent problems due to accidental writes */
   eeprom_safety();
 }
 
+#ifdef CONFIG_SD_AUTOSPEED
+
+/* calculate the check byte of an sdspeed entry */
+static uint8_t sdspeed_check(const sdspeed_t *entry) {
+  const uint8_t *ptr = (const uint8_t *)entry;
+  uint8_t i, sum = 0x5a;
+
+  for (i = 0; i < offsetof(sdspeed_t, check); i++)
+    sum += ptr[i];
+
+  return sum;
+}
+
+/**
+ * read_sdspeed - read a stored SD card clock setting
+ * @index: entry number
+ * @entry: pointer to the entry to fill
+ *
+ * This function reads entry @index of the stored SD card clock
+ * settings. The entries are checked on their own, so they are
+ * available even if no configuration was saved. Returns 1 if
+ * the entry is valid, 0 otherwise.
+ */
+uint8_t read_sdspeed(uint8_t index, sdspeed_t *entry) {
+  eeprom_read_block(entry, &storedconfig.sdspeed[index], sizeof(sdspeed_t));
+  eeprom_safety();
+
+  return entry->check == sdspeed_check(entry);
+}
+
+/**
+ * write_sdspeed - store an SD card clock setting
+ * @index: entry number
+ * @entry: pointer to the entry
+ *
+ * This function stores @entry as entry @index of the SD card clock
+ * settings. If a saved configuration covers the entries, its checksum
+ * is updated to keep it valid.
+ */
+void write_sdspeed(uint8_t index, sdspeed_t *entry) {
+  uint16_t size;
+
+  entry->check = sdspeed_check(entry);
+  eeprom_write_block(entry, &storedconfig.sdspeed[index], sizeof(sdspeed_t));
+
+  size = eeprom_read_word(&storedconfig.structsize);
+  if (size != 0xffff && size > offsetof(typeof(storedconfig), sdspeed))
+    eeprom_write_byte(&storedconfig.checksum, config_checksum(size));
+
+  eeprom_safety();
+}
+
+#endif
+
@@ -28,9 +28,31 @@
 
 #define ROM_NAME_LENGTH 16
 
+/* number of SD cards whose SPI clock setting is stored */
+#define SDSPEED_ENTRIES 4
+
+/**
+ * struct sdspeed_t - stored SPI clock setting of an SD card
+ * @serial : manufacturer ID and serial number from the CID
+ * @divisor: last SSP clock divisor that worked
+ * @floor  : smallest SSP clock divisor that may be tried
+ * @check  : check byte over the other fields
+ */
+typedef struct {
+  uint32_t serial;
+  uint8_t  divisor;
+  uint8_t  floor;
+  uint8_t  check;
+} __attribute__((packed)) sdspeed_t;
+
 extern uint8_t rom_filename[ROM_NAME_LENGTH+1];
 
 void read_configuration(void);
 void write_configuration(void);
 
+#ifdef CONFIG_SD_AUTOSPEED
+uint8_t read_sdspeed(uint8_t index, sdspeed_t *entry);
+void    write_sdspeed(uint8_t index, sdspeed_t *entry);
+#endif
+
 #endif
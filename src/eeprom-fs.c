@@ -37,8 +37,7 @@
 /*  data structures, constants, global variables                             */
 /* ------------------------------------------------------------------------- */
 
-/* avoid writing unchanged bytes to the EEPROM  */
-/* currently implemented only for the directory */
+/* avoid writing unchanged bytes to the EEPROM */
 #define EEPROMFS_MINIMIZE_WRITES
 
 /* a buffer with at least 32 bytes */
@@ -86,6 +85,21 @@ static uint8_t used_sectors[(SECTOR_COUNT + 7) / 8];
 static uint8_t used_entries[(EEPROMFS_ENTRIES + 7) / 8];
 static uint8_t free_sectors;
 
+/* RAM copy of the directory structure to avoid EEPROM reads */
+static uint8_t name_entries[(EEPROMFS_ENTRIES + 7) / 8];
+static uint8_t name_digest[EEPROMFS_ENTRIES];
+
+/* allocation start points, rotated for wear levelling */
+static uint8_t sector_hint;
+static uint8_t entry_hint;
+
+/* write cache for the current sector of a file opened for writing */
+static uint8_t    wcache[EEPROMFS_SECTORSIZE];
+static eefs_fh_t *wcache_fh;     // owner of the cache, NULL if empty
+static uint8_t    wcache_sector; // sector cached
+static uint8_t    wcache_start;  // first byte in the cache that must be written
+static uint8_t    wcache_end;    // end of the bytes that must be written
+
 static nameentry_t *nameptr = (nameentry_t *)EEPROMFS_BUFFER;
 static listentry_t *listptr = (listentry_t *)EEPROMFS_BUFFER;
 
@@ -104,6 +118,37 @@ static bool get_bit(uint8_t *bitmap, uint8_t bit) {
   return bitmap[bit / 8] & (1 << (bit % 8));
 }
 
+/**
+ * digest - calculate a digest of a file name
+ * @name: pointer to file name array
+ *
+ * This function returns an 8 bit digest of the file name @name
+ * that is used to skip directory entries with a different name
+ * without reading them from the EEPROM.
+ */
+static uint8_t digest(uint8_t *name) {
+  uint8_t i, d = 0;
+
+  for (i = 0; i < EEFS_NAME_LENGTH; i++)
+    d = ((d << 1) | (d >> 7)) ^ name[i];
+
+  return d;
+}
+
+/**
+ * set_name_entry - update the RAM copy of a directory entry
+ * @index: index of the directory entry
+ * @name : file name of the entry or NULL if it is not a name entry
+ *
+ * This function records if the directory entry @index holds
+ * the file name @name.
+ */
+static void set_name_entry(uint8_t index, uint8_t *name) {
+  set_bit(name_entries, index, name != NULL);
+  if (name != NULL)
+    name_digest[index] = digest(name);
+}
+
 /**
  * read_entry - read a directory entry
  * @index: index of the directory entry
@@ -118,57 +163,105 @@ static void read_entry(uint8_t index) {
 }
 
 /**
- * write_entry - write a directory entry
- * @index: index of the directory entry
+ * min - returns minimum of two numbers
+ * @a: first number
+ * @b: second number
  *
- * This function writes the directory entry @index
- * from the buffer into the EEPROM.
+ * This function returns the numerically smaller of @a and @b.
  */
-static void write_entry(uint8_t index) {
+static uint16_t min(uint16_t a, uint16_t b) {
+  if (a < b)
+    return a;
+  else
+    return b;
+}
+
+/**
+ * update_block - write a block of data to the EEPROM
+ * @data  : pointer to the data
+ * @addr  : EEPROM address of the data
+ * @length: number of bytes to write
+ *
+ * This function writes @length bytes from @data to the EEPROM
+ * at @addr. With EEPROMFS_MINIMIZE_WRITES only the bytes that
+ * differ from the current EEPROM contents are written.
+ */
+static void update_block(uint8_t *data, uint8_t *addr, uint8_t length) {
 #ifdef EEPROMFS_MINIMIZE_WRITES
   /* write just the changed bytes to the EEPROM */
 
   uint8_t *orig = EEPROMFS_CMP_BUFFER;
-  uint8_t i, nonmatch_start = 0;
-  bool cur_nonmatching = false;
+  uint8_t i, chunk, nonmatch_start = 0;
+  bool cur_nonmatching;
 
-  /* read current entry to minimize writes */
-  eeprom_read_block(orig,
-                    (uint8_t *)(EEPROMFS_OFFSET + sizeof(nameentry_t) * index),
-                    sizeof(nameentry_t));
+  while (length > 0) {
+    /* read current contents in pieces that fit into the compare buffer */
+    chunk = min(length, 32);
+    eeprom_read_block(orig, addr, chunk);
 
-  for (i = 0; i < sizeof(nameentry_t); i++) {
-    if (cur_nonmatching) {
-      if (EEPROMFS_BUFFER[i] == orig[i]) {
-        cur_nonmatching = false;
+    cur_nonmatching = false;
+    for (i = 0; i < chunk; i++) {
+      if (cur_nonmatching) {
+        if (data[i] == orig[i]) {
+          cur_nonmatching = false;
 
-        eeprom_write_block(EEPROMFS_BUFFER + nonmatch_start,
-                             (uint8_t *)(EEPROMFS_OFFSET + sizeof(nameentry_t) * index + nonmatch_start),
+          eeprom_write_block(data + nonmatch_start, addr + nonmatch_start,
                              i - nonmatch_start);
-      }
-    } else {
-      if (EEPROMFS_BUFFER[i] != orig[i]) {
-        cur_nonmatching = true;
-        nonmatch_start  = i;
+        }
+      } else {
+        if (data[i] != orig[i]) {
+          cur_nonmatching = true;
+          nonmatch_start  = i;
+        }
       }
     }
-  }
 
-  if (cur_nonmatching) {
-    /* final block */
-    eeprom_write_block(EEPROMFS_BUFFER + nonmatch_start,
-                       (uint8_t *)(EEPROMFS_OFFSET + sizeof(nameentry_t) * index + nonmatch_start),
-                       sizeof(nameentry_t) - nonmatch_start);
+    if (cur_nonmatching) {
+      /* final block */
+      eeprom_write_block(data + nonmatch_start, addr + nonmatch_start,
+                         chunk - nonmatch_start);
+    }
+
+    data   += chunk;
+    addr   += chunk;
+    length -= chunk;
   }
 
 #else
   /* write everything */
-  eeprom_write_block(EEPROMFS_BUFFER,
-                     (uint8_t *)(EEPROMFS_OFFSET + sizeof(nameentry_t) * index),
-                     sizeof(nameentry_t));
+  eeprom_write_block(data, addr, length);
 #endif
 }
 
+/**
+ * write_entry - write a directory entry
+ * @index: index of the directory entry
+ *
+ * This function writes the directory entry @index
+ * from the buffer into the EEPROM.
+ */
+static void write_entry(uint8_t index) {
+  update_block(EEPROMFS_BUFFER,
+               (uint8_t *)(EEPROMFS_OFFSET + sizeof(nameentry_t) * index),
+               sizeof(nameentry_t));
+}
+
+/**
+ * flush_cache - write the contents of the write cache to the EEPROM
+ *
+ * This function writes the data in the write cache to its sector
+ * and empties the cache.
+ */
+static void flush_cache(void) {
+  if (wcache_fh == NULL)
+    return;
+
+  update_block(wcache + wcache_start,
+               (uint8_t *)(DATA_OFFSET + EEPROMFS_SECTORSIZE * wcache_sector + wcache_start),
+               wcache_end - wcache_start);
+  wcache_fh = NULL;
+}
+
 /**
  * curentry_is_listentry - checks if the current entry is a listentry
  *
@@ -247,16 +340,17 @@ static uint8_t next_free_sector(uint8_t start) {
  * Returns the index of the entry or 0xff if not found.
  */
 static uint8_t find_entry(uint8_t *name) {
-  uint8_t idx = 0;
+  uint8_t idx, d = digest(name);
 
-  while (idx < EEPROMFS_ENTRIES) {
-    read_entry(idx++);
-
-    if (nameptr->flags & (EEFS_FLAG_DELETED | EEFS_FLAG_LISTENTRY))
+  for (idx = 0; idx < EEPROMFS_ENTRIES; idx++) {
+    /* skip other entries without reading them */
+    if (!get_bit(name_entries, idx) || name_digest[idx] != d)
       continue;
 
+    read_entry(idx);
+
     if (!memcmp(nameptr->name, name, EEFS_NAME_LENGTH))
-      return idx - 1;
+      return idx;
   }
 
   return 0xff;
@@ -269,7 +363,8 @@ static uint8_t find_entry(uint8_t *name) {
  * This function searches for an empty directory entry, starting at entry
  * @start to provide a simple wear-levelling mechanism. The entry is NOT
  * marked as used. Returns the index of the entry or 0xff if none available
- * and marks it as used in used_entries.
+ * and marks it as used in used_entries. The next search by a new file
+ * starts behind this entry.
  */
 static uint8_t next_free_entry(uint8_t start) {
   uint8_t cur = start;
@@ -285,21 +380,11 @@ static uint8_t next_free_entry(uint8_t start) {
 
   set_bit(used_entries, cur, true);
 
-  return cur;
-}
+  entry_hint = cur + 1;
+  if (entry_hint == EEPROMFS_ENTRIES)
+    entry_hint = 0;
 
-/**
- * min - returns minimum of two numbers
- * @a: first number
- * @b: second number
- *
- * This function returns the numerically smaller of @a and @b.
- */
-static uint16_t min(uint16_t a, uint16_t b) {
-  if (a < b)
-    return a;
-  else
-    return b;
+  return cur;
 }
 
 /* ------------------------------------------------------------------------- */
@@ -312,6 +397,10 @@ void eepromfs_init(void) {
   free_sectors = SECTOR_COUNT;
   memset(used_sectors, 0, sizeof(used_sectors));
   memset(used_entries, 0, sizeof(used_entries));
+  memset(name_entries, 0, sizeof(name_entries));
+  sector_hint = 0;
+  entry_hint  = 0;
+  wcache_fh   = NULL;
 
   /* scan all directory entries */
   for (i = 0; i < EEPROMFS_ENTRIES; i++) {
@@ -320,14 +409,27 @@ void eepromfs_init(void) {
     /* check if entry is in use */
     if (!(nameptr->flags & EEFS_FLAG_DELETED)) {
       set_bit(used_entries, i, true);
+      entry_hint = i + 1;
+
+      if (!curentry_is_listentry())
+        set_name_entry(i, nameptr->name);
 
       /* mark their sectors as used */
       for (j = 0; j < curentry_max_sectors(); j++) {
-        if (listptr->sectors[j] != SECTOR_FREE)
+        if (listptr->sectors[j] != SECTOR_FREE) {
           mark_sector(listptr->sectors[j], true);
+          if (listptr->sectors[j] >= sector_hint)
+            sector_hint = listptr->sectors[j] + 1;
+        }
       }
     }
   }
+
+  /* continue allocating behind the highest used sector and entry */
+  if (sector_hint >= SECTOR_COUNT)
+    sector_hint = 0;
+  if (entry_hint >= EEPROMFS_ENTRIES)
+    entry_hint = 0;
 }
 
 void eepromfs_format(void) {
@@ -370,14 +472,14 @@ void eepromfs_opendir(eefs_dir_t *dh) {
 uint8_t eepromfs_readdir(eefs_dir_t *dh, eefs_dirent_t *entry) {
   /* loop until a valid new entry is found */
   while (dh->entry < EEPROMFS_ENTRIES) {
-    /* read current entry */
-    read_entry(dh->entry++);
-
-    if (nameptr->flags & EEFS_FLAG_DELETED)
+    /* skip deleted entries and listentries */
+    if (!get_bit(name_entries, dh->entry)) {
+      dh->entry++;
       continue;
+    }
 
-    if (curentry_is_listentry())
-      continue;
+    /* read current entry */
+    read_entry(dh->entry++);
 
     /* copy information */
     memcpy(entry->name, nameptr->name, EEFS_NAME_LENGTH);
@@ -403,6 +505,10 @@ uint8_t eepromfs_readdir(eefs_dir_t *dh, eefs_dirent_t *entry) {
 eefs_error_t eepromfs_open(uint8_t *name, eefs_fh_t *fh, uint8_t flags) {
   uint8_t diridx;
 
+  /* cached data from an earlier file on this handle */
+  if (wcache_fh == fh)
+    flush_cache();
+
   memset(fh, 0, sizeof(eefs_fh_t));
 
   diridx = find_entry(name);
@@ -413,7 +519,7 @@ eefs_error_t eepromfs_open(uint8_t *name, eefs_fh_t *fh, uint8_t flags) {
       return EEFS_ERROR_FILEEXISTS;
 
     /* allocate directory entry */
-    fh->entry = next_free_entry(0);
+    fh->entry = next_free_entry(entry_hint);
     if (fh->entry == 0xff)
       return EEFS_ERROR_DIRFULL;
 
@@ -427,6 +533,7 @@ eefs_error_t eepromfs_open(uint8_t *name, eefs_fh_t *fh, uint8_t flags) {
     nameptr->size  = 0;
     nameptr->flags = 0;
     write_entry(fh->entry);
+    set_name_entry(fh->entry, name);
 
   } else {
     /* read, append: return error if the file does not exist */
@@ -443,8 +550,8 @@ eefs_error_t eepromfs_open(uint8_t *name, eefs_fh_t *fh, uint8_t flags) {
         read_entry(diridx);
       }
 
-      /* search for last allocated sector */
-      uint8_t sectoridx = 0;
+      /* search for last allocated sector, -1 for an empty file */
+      uint8_t sectoridx = (uint8_t)-1;
       for (uint8_t i = 0; i < curentry_max_sectors(); i++) {
         if (listptr->sectors[i] == SECTOR_FREE)
           break;
@@ -452,7 +559,9 @@ eefs_error_t eepromfs_open(uint8_t *name, eefs_fh_t *fh, uint8_t flags) {
         sectoridx = i;
       }
 
-      fh->cur_sector  = listptr->sectors[sectoridx];
+      if (sectoridx != (uint8_t)-1)
+        fh->cur_sector = listptr->sectors[sectoridx];
+      fh->cur_sindex  = sectoridx;
       fh->cur_entry   = diridx;
       fh->cur_offset  = fh->size;
       fh->cur_soffset = fh->size % EEPROMFS_SECTORSIZE;
@@ -492,7 +601,7 @@ eefs_error_t eepromfs_write(eefs_fh_t *fh, void *data, uint16_t length, uint16_t
   while (length > 0) {
     if (fh->cur_soffset == 0) {
       /* need to allocate another sector */
-      uint8_t next_sector = next_free_sector(fh->cur_sector);
+      uint8_t next_sector = next_free_sector(sector_hint);
 
       if (next_sector == SECTOR_FREE)
         return EEFS_ERROR_DISKFULL;
@@ -505,7 +614,7 @@ eefs_error_t eepromfs_write(eefs_fh_t *fh, void *data, uint16_t length, uint16_t
       fh->cur_sindex++;
       if (fh->cur_sindex >= curentry_max_sectors()) {
         /* need to allocate another direntry */
-        uint8_t next_entry = next_free_entry(fh->cur_entry);
+        uint8_t next_entry = next_free_entry(entry_hint);
 
         if (next_entry == 0xff)
           return EEFS_ERROR_DIRFULL;
@@ -524,16 +633,30 @@ eefs_error_t eepromfs_write(eefs_fh_t *fh, void *data, uint16_t length, uint16_t
 
       /* mark sector as used in internal bookkeeping */
       mark_sector(next_sector, true);
+      sector_hint = next_sector + 1;
+      if (sector_hint == SECTOR_COUNT)
+        sector_hint = 0;
 
       /* write new sector number to direntry */
       listptr->sectors[fh->cur_sindex] = next_sector;
       write_entry(fh->cur_entry);
     }
 
+    /* collect the data of the current sector in the write cache */
+    if (wcache_fh != fh || wcache_sector != fh->cur_sector) {
+      flush_cache();
+      wcache_fh     = fh;
+      wcache_sector = fh->cur_sector;
+      wcache_start  = fh->cur_soffset;
+    }
+
     uint8_t bytes_to_write = min(length, EEPROMFS_SECTORSIZE - fh->cur_soffset);
-    eeprom_write_block(bdata,
-                       (uint8_t *)(DATA_OFFSET + EEPROMFS_SECTORSIZE * fh->cur_sector + fh->cur_soffset),
-                       bytes_to_write);
+    memcpy(wcache + fh->cur_soffset, bdata, bytes_to_write);
+    wcache_end = fh->cur_soffset + bytes_to_write;
+
+    /* a full sector will not change anymore */
+    if (wcache_end == EEPROMFS_SECTORSIZE)
+      flush_cache();
 
     /* adjust state */
     bdata           += bytes_to_write;
@@ -620,6 +743,10 @@ eefs_error_t eepromfs_read(eefs_fh_t *fh, void *data, uint16_t length, uint16_t
 void eepromfs_close(eefs_fh_t *fh) {
   // FIXME: Read mode check could be removed if write_entry only writes changed bytes (EEPROMFS_MINIMIZE_WRITES)
   if (fh->filemode != EEFS_MODE_READ) {
+    /* write cached data */
+    if (wcache_fh == fh)
+      flush_cache();
+
     /* write new file length */
     read_entry(fh->entry);
     nameptr->size = fh->size;
@@ -654,6 +781,7 @@ eefs_error_t eepromfs_rename(uint8_t *oldname, uint8_t *newname) {
   memcpy(nameptr->name, newname, EEFS_NAME_LENGTH);
 
   write_entry(diridx);
+  set_name_entry(diridx, newname);
 
   return EEFS_ERROR_OK;
 }
@@ -692,6 +820,8 @@ eefs_error_t eepromfs_delete(uint8_t *name) {
     /* erase the current entry */
     memset(listptr, 0xff, sizeof(*listptr));
     write_entry(old_diridx);
+    set_bit(used_entries, old_diridx, false);
+    set_name_entry(old_diridx, NULL);
 
     /* read next entry */
     if (diridx != 0xff)
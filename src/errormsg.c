@@ -34,7 +34,9 @@
 #include "fatops.h"
 #include "flags.h"
 #include "led.h"
+#include "profile.h"
 #include "progmem.h"
+#include "stats.h"
 #include "ustring.h"
 #include "utils.h"
 #include "errormsg.h"
@@ -168,6 +170,15 @@ static uint8_t *appendmsg(uint8_t *msg, const uint8_t *table, const uint8_t entr
   return msg;
 }
 
+#if defined(CONFIG_PROFILING) || defined(CONFIG_STATISTICS)
+static uint8_t *appendhex32(uint8_t *msg, uint32_t value) {
+  msg = byte_to_hex(value >> 24, msg);
+  msg = byte_to_hex(value >> 16, msg);
+  msg = byte_to_hex(value >>  8, msg);
+  return byte_to_hex(value, msg);
+}
+#endif
+
 static uint8_t *appendbool(uint8_t *msg, uint8_t ch, uint8_t value) {
   if (ch)
     *msg++ = ch;
@@ -230,6 +241,28 @@ void set_error_ts(uint8_t errornum, uint8_t track, uint8_t sector) {
         i++;
       }
       break;
+
+#ifdef CONFIG_PROFILING
+    case 2: // Profiling counters of function number track
+      *msg++ = 'P';
+      msg = appendhex32(msg, profile_data[track].calls);
+      *msg++ = ':';
+      msg = appendhex32(msg, profile_data[track].cycles);
+      *msg++ = ':';
+      msg = appendhex32(msg, profile_data[track].max);
+      break;
+#endif
+
+#ifdef CONFIG_STATISTICS
+    case 3: // Statistics counters, group track
+      *msg++ = 'N';
+      for (i = 0; i < 4; i++) {
+        if (i)
+          *msg++ = ':';
+        msg = appendhex32(msg, stats[track * 4 + i]);
+      }
+      break;
+#endif
     }
 
   } else if (errornum == ERROR_LONGVERSION || errornum == ERROR_DOSVERSION) {
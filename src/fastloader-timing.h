@@ -0,0 +1,112 @@
+/* sd2iec - SD/MMC to Commodore serial bus interface/controller
+   Copyright (C) 2007-2022  Ingo Korb <ingo@akana.de>
+
+   Inspired by MMC2IEC by Lars Pontoppidan et al.
+
+   FAT filesystem access based on code from ChaN and Jim Brain, see ff.c|h.
+
+   This program is free software; you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation; version 2 of the License only.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program; if not, write to the Free Software
+   Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+
+
+   fastloader-timing.h: Bit timing tables shared by the AVR and LPC17xx
+                        low-level fastloader implementations
+
+*/
+
+#ifndef FASTLOADER_TIMING_H
+#define FASTLOADER_TIMING_H
+
+/*
+ * Each 2-bit protocol is described by the times at which bit pairs
+ * 0..3 are put on the bus, in units of 100ns after the start
+ * handshake. NAME_EXIT is the time at which the bus is set to its
+ * final state, if the protocol defines one.
+ *
+ * All protocols in this file send the least significant pair first,
+ * bit 2n on CLOCK and bit 2n+1 on DATA. This matches
+ * send_bits_to_clk_data in the AVR implementation.
+ *
+ * This file is included by the AVR assembler source, so everything
+ * outside the __ASSEMBLER__ block must be plain preprocessor macros.
+ */
+
+/* N0stalgia DOS fileread, byte transmission */
+#define FLT_N0SDOS_SEND_0     90
+#define FLT_N0SDOS_SEND_1     170
+#define FLT_N0SDOS_SEND_2     250
+#define FLT_N0SDOS_SEND_3     330
+#define FLT_N0SDOS_SEND_EXIT  380
+
+/* Action Replay 6, 1581 byte transmission */
+#define FLT_AR6_1581_SEND_0    50
+#define FLT_AR6_1581_SEND_1    130
+#define FLT_AR6_1581_SEND_2    210
+#define FLT_AR6_1581_SEND_3    290
+#define FLT_AR6_1581_SEND_EXIT 375
+
+/* GEOS 1581 Configure 2.1, byte transmission */
+#define FLT_GEOS_1581_21_SEND_0 70
+#define FLT_GEOS_1581_21_SEND_1 140
+#define FLT_GEOS_1581_21_SEND_2 240
+#define FLT_GEOS_1581_21_SEND_3 330
+
+/* Wheels 4.4 2MHz, byte transmission */
+#define FLT_WHEELS44_2MHZ_SEND_0 70
+#define FLT_WHEELS44_2MHZ_SEND_1 150
+#define FLT_WHEELS44_2MHZ_SEND_2 260
+#define FLT_WHEELS44_2MHZ_SEND_3 370
+
+
+/* --- AVR helpers, the AVR fastloaders assume an 8MHz clock --- */
+
+/* Convert 100ns units to AVR cycles */
+#define FLT_AVR_CYCLES(ticks) ((ticks) * 8 / 10)
+
+/* AVR cycles from the start handshake to pair 0 */
+#define FLT_AVR_FIRST(name) FLT_AVR_CYCLES(name##_0)
+
+/* AVR cycles between two points of a timing table */
+#define FLT_AVR_GAP(name, from, to) FLT_AVR_CYCLES(name##_##to - name##_##from)
+
+/* Cycles used by send_bits_to_clk_data plus the shortest delay_cycles */
+#define FLT_AVR_MIN_GAP (16 + 10)
+
+
+#ifndef __ASSEMBLER__
+
+/* Initializer for a generic_2bit_t (LPC17xx) from a timing table */
+#define FLT_GENERIC_2BIT(name, eor) {               \
+    .pairtimes = { name##_0, name##_1, name##_2, name##_3 }, \
+    .clockbits = { 0, 2, 4, 6 },                    \
+    .databits  = { 1, 3, 5, 7 },                    \
+    .eorvalue  = (eor)                              \
+  }
+
+/* Compile-time check that the AVR implementation can meet a timing table */
+#define FLT_CHECK_2BIT(name)                                            \
+  _Static_assert(name##_0 < name##_1 && name##_1 < name##_2 &&          \
+                 name##_2 < name##_3, #name " is not in ascending order"); \
+  _Static_assert(FLT_AVR_GAP(name, 0, 1) >= FLT_AVR_MIN_GAP &&          \
+                 FLT_AVR_GAP(name, 1, 2) >= FLT_AVR_MIN_GAP &&          \
+                 FLT_AVR_GAP(name, 2, 3) >= FLT_AVR_MIN_GAP,            \
+                 #name " bit pairs are too close for AVR")
+
+FLT_CHECK_2BIT(FLT_N0SDOS_SEND);
+FLT_CHECK_2BIT(FLT_AR6_1581_SEND);
+FLT_CHECK_2BIT(FLT_GEOS_1581_21_SEND);
+FLT_CHECK_2BIT(FLT_WHEELS44_2MHZ_SEND);
+
+#endif
+
+#endif
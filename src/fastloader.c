@@ -32,6 +32,7 @@
 #include "config.h"
 #include "diskchange.h"
 #include "fastloader-ll.h"
+#include "fastloader-timing.h" /* runs the timing checks for the AVR code */
 #include "iec-bus.h"
 #include "iec.h"
 #include "led.h"
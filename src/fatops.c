@@ -44,6 +44,7 @@
 #include "p00cache.h"
 #include "parser.h"
 #include "progmem.h"
+#include "timer.h"
 #include "uart.h"
 #include "utils.h"
 #include "ustring.h"
@@ -761,6 +762,37 @@ FRESULT create_file(path_t *path, cbmdirent_t *dent, uint8_t type, buffer_t *buf
   return FR_OK;
 }
 
+/**
+ * image_size_hint - expected size of a new disk image file
+ * @name: pointer to the file name
+ *
+ * This function returns the size of a standard disk image of the type
+ * indicated by the extension of name or 0 if the size is not known
+ * in advance.
+ */
+static uint32_t image_size_hint(uint8_t *name) {
+  uint8_t *ext;
+
+  if (check_imageext(name) != IMG_IS_DISK)
+    return 0;
+
+  ext = ustrrchr(name, '.');
+  switch (toupper(ext[2])) {
+  case '6':
+  case '4':
+    return 174848UL; /* D64/D41 */
+
+  case '7':
+    return 349696UL; /* D71 */
+
+  case '8':
+    return 819200UL; /* D81 */
+
+  default:
+    return 0;        /* DNP can have any size */
+  }
+}
+
 /**
  * fat_open_write - opens a file for writing
  * @path  : path of the file
@@ -785,9 +817,14 @@ void fat_open_write(path_t *path, cbmdirent_t *dent, uint8_t type, buffer_t *buf
     if (res == FR_OK)
       res = f_lseek(&buf->pvt.fat.fh, buf->pvt.fat.fh.fsize);
     buf->fptr = buf->pvt.fat.fh.fsize - buf->pvt.fat.headersize;
-  } else
+  } else {
     res = create_file(path, dent, type, buf, 0);
 
+    /* Keep disk images contiguous by reserving their clusters up front */
+    if (res == FR_OK)
+      res = f_prealloc(&buf->pvt.fat.fh, image_size_hint(dent->name));
+  }
+
   if (res != FR_OK) {
     parse_error(res,0);
     return;
@@ -1142,10 +1179,13 @@ uint8_t fat_chdir(path_t *path, cbmdirent_t *dent) {
         return 1;
       }
 
+      display_menu_invalidate();
+
 #ifdef CONFIG_M2I
-      if (check_imageext(dent->pvt.fat.realname) == IMG_IS_M2I)
+      if (check_imageext(dent->pvt.fat.realname) == IMG_IS_M2I) {
+        m2i_index_invalidate();
         partition[path->part].fop = &m2iops;
-      else
+      } else
 #endif
         {
           if (d64_mount(path, dent->pvt.fat.realname))
@@ -1485,10 +1525,14 @@ void fat_rename(path_t *path, cbmdirent_t *dent, uint8_t *newname) {
 void fatops_init(uint8_t preserve_path) {
   FRESULT res;
   uint8_t realdrive,drive,part;
+#ifdef CONFIG_UART_DEBUG
+  tick_t start = getticks();
+#endif
 
   max_part = 0;
   drive = 0;
   part = 0;
+  display_menu_invalidate();
   while (max_part < CONFIG_MAX_PARTITIONS && drive < MAX_DRIVES) {
     partition[max_part].fop = &fatops;
 
@@ -1514,6 +1558,16 @@ void fatops_init(uint8_t preserve_path) {
     }
   }
 
+#ifdef CONFIG_UART_DEBUG
+  start = getticks() - start;
+  uart_puts_P(PSTR("mount "));
+  uart_puthex(max_part);
+  uart_putc(' ');
+  uart_puthex(start >> 8);
+  uart_puthex(start & 0xff);
+  uart_putcrlf();
+#endif
+
   if (!preserve_path) {
     current_part = 0;
     display_current_part(0);
@@ -1574,6 +1628,8 @@ uint8_t image_unmount(uint8_t part) {
 
   partition[part].fop = &fatops;
   res = f_close(&partition[part].imagehandle);
+  if (disk_flush() != RES_OK && res == FR_OK)
+    res = FR_RW_ERROR;
   if (res != FR_OK) {
     parse_error(res,0);
     return 1;
@@ -1688,6 +1744,30 @@ uint8_t image_write(uint8_t part, DWORD offset, void *buffer, uint16_t bytes, ui
   return 0;
 }
 
+/**
+ * image_sync - flush pending writes of an image file
+ * @part: partition number
+ *
+ * This function writes back all data that was written to the image
+ * file on partition part with image_write without the flush flag and
+ * updates its directory entry. It does nothing if no data is pending.
+ * Returns 0 on success or 2 on failure.
+ */
+uint8_t image_sync(uint8_t part) {
+  FRESULT res;
+
+  if (!(partition[part].imagehandle.flag & FA__WRITTEN))
+    return 0;
+
+  res = f_sync(&partition[part].imagehandle);
+  if (res != FR_OK) {
+    parse_error(res,0);
+    return 2;
+  }
+
+  return 0;
+}
+
 /* Dummy function for format */
 void format_dummy(uint8_t drive, uint8_t *name, uint8_t *id) {
   (void)drive;
@@ -58,7 +58,9 @@
 #include "config.h"
 #include "ff.h"         /* FatFs declarations */
 #include "diskio.h"     /* Include file for user provided disk functions */
+#include "profile.h"
 #include "progmem.h"
+#include "stats.h"
 
 
 /*--------------------------------------------------------------------------
@@ -119,6 +121,9 @@ BOOL move_window (      /* TRUE: successful, FALSE: failed */
 #endif
 #if !_FS_READONLY
     BYTE n;
+#endif
+    profile_enter(PROF_FAT_WINDOW);
+#if !_FS_READONLY
     if (buf->dirty) {                   /* Write back dirty window if needed */
       if (disk_write(ofs->drive, buf->data, wsect, 1) != RES_OK)
         return FALSE;
@@ -132,6 +137,7 @@ BOOL move_window (      /* TRUE: successful, FALSE: failed */
     }
 #endif
     if (sector) {
+      stats_inc(STAT_FAT_WINDOW_LOADS);
       if (disk_read(fs->drive, buf->data, sector, 1) != RES_OK)
         return FALSE;
       buf->sect = sector;
@@ -139,6 +145,7 @@ BOOL move_window (      /* TRUE: successful, FALSE: failed */
       buf->fs=fs;
 #endif
     }
+    profile_exit(PROF_FAT_WINDOW);
   }
   return TRUE;
 }
@@ -170,6 +177,28 @@ BOOL move_fp_window(
 
 
 
+/*-----------------------------------------------------------------------*/
+/* Check if the file window holds a sector of a direct transfer          */
+/*-----------------------------------------------------------------------*/
+
+#if !_FS_READONLY
+static
+BOOL fp_window_hit (    /* TRUE: the window is one of the sectors */
+  FIL* fp,              /* Pointer to the file object */
+  DWORD sect,           /* First sector of the transfer */
+  UINT cc               /* Number of sectors */
+)
+{
+#if _USE_1_BUF != 0
+  if (FPBUF.fs != fp->fs) return FALSE;
+#endif
+  return FPBUF.sect - sect < cc;
+}
+#endif /* !_FS_READONLY */
+
+
+
+
 /*-----------------------------------------------------------------------*/
 /* Clean-up cached data                                                  */
 /*-----------------------------------------------------------------------*/
@@ -299,6 +328,42 @@ BOOL put_cluster (      /* TRUE: successful, FALSE: failed */
 
 
 
+/*-----------------------------------------------------------------------*/
+/* Free cluster summary                                                  */
+/*-----------------------------------------------------------------------*/
+
+#if !_FS_READONLY && _FREEMAP_SIZE
+static
+BOOL freemap_test (     /* FALSE: the group has no free cluster */
+  FATFS *fs,            /* File system object */
+  DWORD clust           /* Any cluster# of the group */
+)
+{
+  DWORD grp = clust >> fs->fm_shift;
+
+  return (fs->freemap[grp / 8] >> (grp & 7)) & 1;
+}
+
+
+static
+void freemap_set (
+  FATFS *fs,            /* File system object */
+  DWORD clust,          /* Any cluster# of the group */
+  BOOL hasfree          /* FALSE: the group has no free cluster */
+)
+{
+  DWORD grp = clust >> fs->fm_shift;
+
+  if (hasfree)
+    fs->freemap[grp / 8] |= 1 << (grp & 7);
+  else
+    fs->freemap[grp / 8] &= ~(1 << (grp & 7));
+}
+#endif
+
+
+
+
 /*-----------------------------------------------------------------------*/
 /* Remove a cluster chain                                                */
 /*-----------------------------------------------------------------------*/
@@ -317,11 +382,17 @@ BOOL remove_chain (     /* TRUE: successful, FALSE: failed */
     nxt = get_cluster(fs, clust);
     if (nxt == 1) return FALSE;
     if (!put_cluster(fs, clust, 0)) return FALSE;
+#if _FREEMAP_SIZE
+    freemap_set(fs, clust, TRUE);
+    fs->fm_grpfree = TRUE;
+#endif
     if (fs->free_clust != 0xFFFFFFFF) {
       fs->free_clust++;
 #if _USE_FSINFO
       fs->fsi_flag = 1;
 #endif
+    } else if (clust < fs->fc_done) {
+      fs->fc_free++;                      /* Already counted as used */
     }
     clust = nxt;
   }
@@ -344,6 +415,10 @@ DWORD create_chain (    /* 0: No free cluster, 1: Error, >=2: New cluster number
 )
 {
   DWORD cstat, ncl, scl, mcl = fs->max_clust;
+#if _FREEMAP_SIZE
+  DWORD gmask = ((DWORD)1 << fs->fm_shift) - 1;
+  BOOL gscan = FALSE;                     /* Current group checked from its start */
+#endif
 
 
   if (clust == 0) {                       /* Create new chain */
@@ -364,9 +439,25 @@ DWORD create_chain (    /* 0: No free cluster, 1: Error, >=2: New cluster number
       ncl = 2;
       if (ncl > scl) return 0;            /* No free custer */
     }
+#if _FREEMAP_SIZE
+    if ((ncl & gmask) == 0 || ncl == 2) { /* Start of a group */
+      if (!freemap_test(fs, ncl)) {       /* Skip it if it has no free cluster */
+        if (scl >= ncl && scl <= (ncl | gmask)) return 0;
+        ncl |= gmask;
+        continue;
+      }
+      gscan = TRUE;
+    }
+#endif
     cstat = get_cluster(fs, ncl);         /* Get the cluster status */
     if (cstat == 0) break;                /* Found a free cluster */
     if (cstat == 1) return 1;             /* Any error occured */
+#if _FREEMAP_SIZE
+    if (gscan && ((ncl & gmask) == gmask || ncl == mcl - 1)) {
+      freemap_set(fs, ncl, FALSE);        /* Whole group is in use */
+      gscan = FALSE;
+    }
+#endif
     if (ncl == scl) return 0;             /* No free custer */
   }
 
@@ -379,6 +470,8 @@ DWORD create_chain (    /* 0: No free cluster, 1: Error, >=2: New cluster number
 #if _USE_FSINFO
     fs->fsi_flag = 1;
 #endif
+  } else if (ncl < fs->fc_done) {
+    fs->fc_free--;                        /* Already counted as free */
   }
 
   return ncl;   /* Return new cluster number */
@@ -388,6 +481,45 @@ DWORD create_chain (    /* 0: No free cluster, 1: Error, >=2: New cluster number
 
 
 
+/*-----------------------------------------------------------------------*/
+/* Release the clusters behind the end of a file                         */
+/*-----------------------------------------------------------------------*/
+
+#if !_FS_READONLY
+static
+BOOL trim_chain (       /* TRUE: successful, FALSE: failed */
+  FIL *fp               /* Pointer to the file object */
+)
+{
+  FATFS *fs = fp->fs;
+  DWORD clust, nxt, n;
+
+
+  clust = fp->org_clust;
+  if (fp->fsize == 0) {                   /* Nothing written, release all */
+    fp->org_clust = 0;
+    return remove_chain(fs, clust);
+  }
+
+  n = (fp->fsize - 1) / ((DWORD)fs->csize * SS(fs));
+  while (n--) {                           /* Find the last used cluster */
+    clust = get_cluster(fs, clust);
+    if (clust < 2 || clust >= fs->max_clust) return FALSE;
+  }
+
+  nxt = get_cluster(fs, clust);
+  if (nxt == 1) return FALSE;
+  if (nxt >= 2 && nxt < fs->max_clust) {  /* Release the unused clusters */
+    if (!put_cluster(fs, clust, 0x0FFFFFFF)) return FALSE;
+    return remove_chain(fs, nxt);
+  }
+  return TRUE;
+}
+#endif /* !_FS_READONLY */
+
+
+
+
 /*-----------------------------------------------------------------------*/
 /* Get sector# from cluster#                                             */
 /*-----------------------------------------------------------------------*/
@@ -1016,6 +1148,16 @@ FRESULT mount_drv(
 
 #if !_FS_READONLY
   fs->free_clust = 0xFFFFFFFF;
+  fs->fc_done = 0;
+  fs->fc_free = 0;
+# if _FREEMAP_SIZE
+  /* Cover the whole FAT, a group is at least one FAT sector */
+  fs->fm_shift = (fmt == FS_FAT32) ? 7 : (fmt == FS_FAT16) ? 8 : 0;
+  while (((maxclust - 1) >> fs->fm_shift) >= _FREEMAP_SIZE * 8)
+    fs->fm_shift++;
+  memset(fs->freemap, 0xff, _FREEMAP_SIZE);
+  fs->fm_grpfree = FALSE;
+# endif
 # if _USE_FSINFO
   /* Get fsinfo if needed */
   if (fmt == FS_FAT32) {
@@ -1505,7 +1647,7 @@ FRESULT f_open (
   fp->dir_sect = FSBUF.sect;          /* Pointer to the directory entry */
   fp->dir_ptr = dir;
 #endif
-  fp->flag = mode;                    /* File access mode */
+  fp->flag = mode & (FA_READ|FA_WRITE|FA__WRITTEN); /* File access mode */
   fp->org_clust =                     /* File start cluster */
     ((DWORD)LD_WORD(&dir[DIR_FstClusHI]) << 16) | LD_WORD(&dir[DIR_FstClusLO]);
   fp->fsize = LD_DWORD(&dir[DIR_FileSize]);         /* File size */
@@ -1564,6 +1706,7 @@ FRESULT f_read (
   if (!(fp->flag & FA_READ)) return FR_DENIED;  /* Check access mode */
   remain = fp->fsize - fp->fptr;
   if (btr > remain) btr = (UINT)remain;         /* Truncate read count by number of bytes left */
+  profile_enter(PROF_F_READ);
 
   for ( ;  btr;                                 /* Repeat until all data transferred */
     rbuff += rcnt, fp->fptr += rcnt, *br += rcnt, btr -= rcnt) {
@@ -1579,15 +1722,17 @@ FRESULT f_read (
         sect = clust2sect(fs, clust);           /* Get current sector */
         fp->csect = fs->csize;                  /* Re-initialize the left sector counter */
       }
-#if !_FS_READONLY
-      if(!move_fp_window(fp,0)) goto fr_error;
-#endif
       fp->curr_sect = sect;           /* Update current sector */
       cc = btr / SS(fs);              /* When left bytes >= SS(fs), */
       if (cc) {                       /* Read maximum contiguous sectors directly */
         if (cc > fp->csect) cc = fp->csect;
         if (disk_read(fs->drive, rbuff, sect, (BYTE)cc) != RES_OK)
           goto fr_error;
+#if !_FS_READONLY
+        /* The window is left alone, but its data is newer if it is dirty */
+        if (FPBUF.dirty && fp_window_hit(fp, sect, cc))
+          memcpy(rbuff + (FPBUF.sect - sect) * SS(fs), FPBUF.data, SS(fs));
+#endif
         fp->csect -= (BYTE)(cc - 1);
         fp->curr_sect += cc - 1;
         rcnt = cc * SS(fs);
@@ -1602,6 +1747,7 @@ FRESULT f_read (
     }
   }
 
+  profile_exit(PROF_F_READ);
   return FR_OK;
 
 fr_error: /* Abort this file due to an unrecoverable error */
@@ -1637,6 +1783,7 @@ FRESULT f_write (
   if (fp->flag & FA__ERROR) return FR_RW_ERROR;   /* Check error flag */
   if (!(fp->flag & FA_WRITE)) return FR_DENIED;   /* Check access mode */
   if (fp->fsize + btw < fp->fsize) return FR_OK;  /* File size cannot reach 4GB */
+  profile_enter(PROF_F_WRITE);
 
   for ( ;  btw;                                   /* Repeat until all data transferred */
     wbuff += wcnt, fp->fptr += wcnt, *bw += wcnt, btw -= wcnt) {
@@ -1657,13 +1804,19 @@ FRESULT f_write (
         sect = clust2sect(fs, clust);             /* Get current sector */
         fp->csect = fs->csize;                    /* Re-initialize the left sector counter */
       }
+#if _USE_1_BUF == 0
       if(!move_fp_window(fp,0)) goto fw_error;
+#endif
       fp->curr_sect = sect;                       /* Update current sector */
       cc = btw / SS(fs);                          /* When left bytes >= SS(fs), */
       if (cc) {                                   /* Write maximum contiguous sectors directly */
         if (cc > fp->csect) cc = fp->csect;
         if (disk_write(fs->drive, wbuff, sect, (BYTE)cc) != RES_OK)
           goto fw_error;
+        if (fp_window_hit(fp, sect, cc)) {        /* Keep the window up to date */
+          memcpy(FPBUF.data, wbuff + (FPBUF.sect - sect) * SS(fs), SS(fs));
+          FPBUF.dirty = FALSE;
+        }
         fp->csect -= (BYTE)(cc - 1);
         fp->curr_sect += cc - 1;
         wcnt = cc * SS(fs);
@@ -1686,6 +1839,7 @@ FRESULT f_write (
 
   if (fp->fptr > fp->fsize) fp->fsize = fp->fptr; /* Update file size if needed */
   fp->flag |= FA__WRITTEN;                        /* Set file changed flag */
+  profile_exit(PROF_F_WRITE);
   return FR_OK;
 
 fw_error: /* Abort this file due to an unrecoverable error */
@@ -1696,6 +1850,105 @@ fw_error: /* Abort this file due to an unrecoverable error */
 
 
 
+/*-----------------------------------------------------------------------*/
+/* Reserve contiguous clusters for a new file                            */
+/*-----------------------------------------------------------------------*/
+
+#if !_FREEMAP_SIZE
+/* FAT sectors searched for a free run without the free cluster map */
+#define PREALLOC_SCAN_SECTORS 8
+#endif
+
+FRESULT f_prealloc (
+  FIL *fp,          /* Pointer to the file object of an empty file */
+  DWORD size        /* Expected size of the file */
+)
+{
+  FRESULT res;
+  DWORD need, run, scl, ncl, cstat, mcl;
+  FATFS *fs = fp->fs;
+#if _FREEMAP_SIZE
+  DWORD gmask;
+#else
+  DWORD left;
+#endif
+
+
+  res = validate(fs /*, fp->id*/);
+  if (res != FR_OK) return res;
+  if (!(fp->flag & FA_WRITE) || fp->org_clust || !size) return FR_OK;
+  mcl = fs->max_clust;
+  need = (size - 1) / ((DWORD)fs->csize * SS(fs)) + 1;
+  if (need > mcl - 2) return FR_OK;
+#if _FREEMAP_SIZE
+  gmask = ((DWORD)1 << fs->fm_shift) - 1;
+#else
+  /* Every cluster costs a FAT lookup, so only search a few FAT sectors */
+  left = (DWORD)PREALLOC_SCAN_SECTORS * SS(fs) / (fs->fs_type == FS_FAT32 ? 4 : 2);
+  if (need > left) return FR_OK;
+#endif
+
+  /* Search need free clusters in a row after the last allocation */
+  scl = fs->last_clust;
+  if (scl < 2 || scl >= mcl) scl = 2;
+  ncl = scl;
+  run = 0;
+  do {
+#if _FREEMAP_SIZE
+    if ((ncl & gmask) == 0 && !freemap_test(fs, ncl)) {
+      /* No free cluster in this group */
+      if (scl > ncl && scl <= (ncl | gmask)) return FR_OK;
+      ncl |= gmask;
+      run = 0;
+    } else
+#endif
+    {
+      cstat = get_cluster(fs, ncl);
+      if (cstat == 1) return FR_RW_ERROR;
+      if (cstat != 0)
+        run = 0;
+      else if (++run == need)
+        break;
+#if !_FREEMAP_SIZE
+      if (--left == 0) return FR_OK;      /* Give up, allocate on demand */
+#endif
+    }
+    if (++ncl >= mcl) {                   /* Wrap around, no run over the end */
+      ncl = 2;
+      run = 0;
+    }
+  } while (ncl != scl);
+  if (run != need) return FR_OK;          /* Not found, allocate on demand */
+
+  /* Link the clusters */
+  scl = ncl - need + 1;
+  for (ncl = scl; ncl < scl + need - 1; ncl++)
+    if (!put_cluster(fs, ncl, ncl + 1)) goto fp_error;
+  if (!put_cluster(fs, ncl, 0x0FFFFFFF)) goto fp_error;
+
+  fs->last_clust = ncl;
+  if (fs->free_clust != 0xFFFFFFFF) {
+    fs->free_clust -= need;
+#if _USE_FSINFO
+    fs->fsi_flag = 1;
+#endif
+  } else if (scl < fs->fc_done) {
+    /* Part of the clusters was already counted as free */
+    fs->fc_free -= (ncl < fs->fc_done ? ncl + 1 : fs->fc_done) - scl;
+  }
+
+  fp->org_clust = scl;
+  fp->flag |= FA__PREALLOC | FA__WRITTEN;
+  return FR_OK;
+
+fp_error: /* Abort this file due to an unrecoverable error */
+  fp->flag |= FA__ERROR;
+  return FR_RW_ERROR;
+}
+
+
+
+
 /*-----------------------------------------------------------------------*/
 /* Synchronize the file object                                           */
 /*-----------------------------------------------------------------------*/
@@ -1749,7 +2002,14 @@ FRESULT f_close (
 
 
 #if !_FS_READONLY
-  res = f_sync(fp);
+  res = validate(fp->fs /*, fp->id*/);
+  if (res == FR_OK && (fp->flag & FA__PREALLOC)) {
+    /* Release the reserved clusters that were not used */
+    fp->flag &= (BYTE)~FA__PREALLOC;
+    fp->flag |= FA__WRITTEN;
+    if (!trim_chain(fp)) res = FR_RW_ERROR;
+  }
+  if (res == FR_OK) res = f_sync(fp);
 #else
   res = validate(fp->fs /*, fp->id*/);
 #endif
@@ -2160,60 +2420,111 @@ FRESULT l_getfree (
 )
 {
   FRESULT res;
-  DWORD n, clust, sect;
-  BYTE fat, f, *p;
 
   /* Get drive number */
   res = auto_mount(&drv, &fs, 0);
   if (res != FR_OK) return res;
 
-  /* If number of free cluster is valid, return it without cluster scan. */
-  if (fs->free_clust <= fs->max_clust - 2) {
-    *nclust = fs->free_clust;
-    return FR_OK;
+  /* Continue the count where it was stopped before */
+  while (fs->free_clust > fs->max_clust - 2) {
+    if (maxclust && fs->fc_free >= maxclust) {
+      *nclust = maxclust;
+      return FR_OK;
+    }
+    res = l_countfree_step(fs);
+    if (res != FR_OK) return res;
   }
 
-  /* Get number of free clusters */
-  fat = fs->fs_type;
-  n = 0;
-  if (fat == FS_FAT12) {
-    clust = 2;
+  *nclust = fs->free_clust;
+  return FR_OK;
+}
+
+/*-----------------------------------------------------------------------*/
+/* Count Free Clusters, one FAT sector per call                          */
+/*-----------------------------------------------------------------------*/
+
+FRESULT l_countfree_step (
+  FATFS *fs           /* Pointer to file system object (must be mounted) */
+)
+{
+  DWORD cnt, n;
+  BYTE *p;
+#if _FREEMAP_SIZE
+  DWORD gmask = ((DWORD)1 << fs->fm_shift) - 1;
+#endif
+
+  /* Nothing to do if the number of free clusters is known */
+  if (!fs->fs_type || fs->free_clust <= fs->max_clust - 2) return FR_OK;
+
+  if (fs->fs_type == FS_FAT12) {
+    /* Small FAT, scan it in one go */
+    cnt = 2;
+    n = 0;
     do {
-      if ((WORD)get_cluster(fs, clust) == 0) n++;
-    } while (++clust < fs->max_clust);
+      if ((WORD)get_cluster(fs, cnt) == 0) n++;
+    } while (++cnt < fs->max_clust);
+    fs->fc_done = fs->max_clust;
+    fs->fc_free = n;
   } else {
-    clust = fs->max_clust;
-    sect = fs->fatbase;
-    f = 0; p = 0;
-    do {
-      if (maxclust && n >= maxclust) {
-        n = maxclust;
-        break;
+#if _FREEMAP_SIZE
+    /* Skip groups without free clusters, a group is at least one sector */
+    while ((fs->fc_done & gmask) == 0 && !freemap_test(fs, fs->fc_done)) {
+      fs->fc_done += gmask + 1;
+      if (fs->fc_done >= fs->max_clust) {
+        fs->fc_done = fs->max_clust;
+        goto finished;
       }
-      if (!f) {
-        if (!move_fs_window(fs, sect++)) return FR_RW_ERROR;
-        p = FSBUF.data;
-      }
-      if (fat == FS_FAT16) {
+    }
+    if ((fs->fc_done & gmask) == 0)
+      fs->fm_grpfree = FALSE;
+#endif
+    if (fs->fs_type == FS_FAT16) {
+      if (!move_fs_window(fs, fs->fatbase + fs->fc_done / (SS(fs) / 2))) return FR_RW_ERROR;
+      p = FSBUF.data + (fs->fc_done & (SS(fs) / 2 - 1)) * 2;
+      cnt = SS(fs) / 2 - (fs->fc_done & (SS(fs) / 2 - 1));
+    } else {
+      if (!move_fs_window(fs, fs->fatbase + fs->fc_done / (SS(fs) / 4))) return FR_RW_ERROR;
+      p = FSBUF.data + (fs->fc_done & (SS(fs) / 4 - 1)) * 4;
+      cnt = SS(fs) / 4 - (fs->fc_done & (SS(fs) / 4 - 1));
+    }
+    if (cnt > fs->max_clust - fs->fc_done) cnt = fs->max_clust - fs->fc_done;
+
+    fs->fc_done += cnt;
+    n = 0;
+    do {
+      if (fs->fs_type == FS_FAT16) {
         if (LD_WORD(p) == 0) n++;
-        p += 2; f += 1;
+        p += 2;
       } else {
-        if (LD_DWORD(p) == 0) n++;
-        p += 4; f += 2;
+        if ((LD_DWORD(p) & 0x0FFFFFFF) == 0) n++;
+        p += 4;
       }
-    } while (--clust);
+    } while (--cnt);
+    fs->fc_free += n;
+
+#if _FREEMAP_SIZE
+    if (n) fs->fm_grpfree = TRUE;
+    if ((fs->fc_done & gmask) == 0 || fs->fc_done >= fs->max_clust) {
+      /* End of a group */
+      if (!fs->fm_grpfree) freemap_set(fs, fs->fc_done - 1, FALSE);
+    }
+#endif
   }
-  if (n < maxclust) {
-    fs->free_clust = n;
+
+#if _FREEMAP_SIZE
+ finished:
+#endif
+  if (fs->fc_done >= fs->max_clust) {
+    fs->free_clust = fs->fc_free;
 #if _USE_FSINFO
-    if (fat == FS_FAT32) fs->fsi_flag = 1;
+    if (fs->fs_type == FS_FAT32) fs->fsi_flag = 1;
 #endif
   }
-
-  *nclust = n;
   return FR_OK;
 }
 
+
+
 /*-----------------------------------------------------------------------*/
 /* Get Number of Free Clusters                                           */
 /*-----------------------------------------------------------------------*/
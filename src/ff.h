@@ -108,6 +108,16 @@
 /  _USE_DRIVE_PREFIX = 0  */
 #define _USE_DEFERRED_MOUNT 0
 
+/* Size of the free cluster summary of each file system in bytes, 0 disables
+/  it. Every bit covers a group of FAT sectors and is cleared when the group
+/  is known to contain no free cluster, so allocations and free cluster counts
+/  skip the full parts of the FAT.  */
+#ifdef CONFIG_FAT_FREEMAP
+#define _FREEMAP_SIZE CONFIG_FAT_FREEMAP
+#else
+#define _FREEMAP_SIZE 0
+#endif
+
 /* New features in 0.05a, not required yet */
 #define _USE_TRUNCATE 0
 #define _USE_UTIME   0
@@ -160,6 +170,13 @@ typedef struct _FATFS {
 #if !_FS_READONLY
     DWORD   last_clust;     /* Last allocated cluster */
     DWORD   free_clust;     /* Number of free clusters */
+    DWORD   fc_done;        /* Number of FAT entries counted so far */
+    DWORD   fc_free;        /* Number of free clusters counted so far */
+#if _FREEMAP_SIZE
+    BYTE    fm_shift;       /* log2 of the number of clusters per freemap bit */
+    BYTE    fm_grpfree;     /* Free cluster seen in the group being counted */
+    BYTE    freemap[_FREEMAP_SIZE]; /* Bit cleared: group has no free cluster */
+#endif
 #if _USE_FSINFO
     DWORD   fsi_sector;     /* fsinfo sector */
     BYTE    fsi_flag;       /* fsinfo dirty flag (1:must be written back) */
@@ -282,6 +299,7 @@ FRESULT f_readdir (DIR*, FILINFO*);                         /* Read a directory
 FRESULT f_stat (FATFS*, const UCHAR*, FILINFO*);            /* Get file status */
 FRESULT f_getfree (FATFS*, const UCHAR*, DWORD*);           /* Get number of free clusters on the drive */
 FRESULT f_sync (FIL*);                                      /* Flush cached data of a writing file */
+FRESULT f_prealloc (FIL*, DWORD);                           /* Reserve contiguous clusters for a new file */
 FRESULT f_unlink (FATFS*, const UCHAR*);                    /* Delete an existing file or directory */
 FRESULT f_mkdir (FATFS*, const UCHAR*);                     /* Create a new directory */
 FRESULT f_chmod (FATFS*, const UCHAR*, BYTE, BYTE);         /* Change file/dir attriburte */
@@ -302,6 +320,7 @@ FRESULT f_readdir (DIR*, FILINFO*);                         /* Read a directory
 FRESULT f_stat (const UCHAR*, FILINFO*);                    /* Get file status */
 FRESULT f_getfree (const UCHAR*, DWORD*, FATFS**);          /* Get number of free clusters on the drive */
 FRESULT f_sync (FIL*);                                      /* Flush cached data of a writing file */
+FRESULT f_prealloc (FIL*, DWORD);                           /* Reserve contiguous clusters for a new file */
 FRESULT f_unlink (const UCHAR*);                            /* Delete an existing file or directory */
 FRESULT f_mkdir (const UCHAR*);                             /* Create a new directory */
 FRESULT f_chmod (const UCHAR*, BYTE, BYTE);                 /* Change file/dir attriburte */
@@ -315,6 +334,7 @@ FRESULT f_chdir (const UCHAR*);                             /* Change current di
 FRESULT l_opendir(FATFS* fs, DWORD cluster, DIR *dirobj);   /* Open an existing directory by its start cluster */
 FRESULT l_opencluster(FATFS *fs, FIL *fp, DWORD clust);     /* Open a cluster by number as a read-only file */
 FRESULT l_getfree (FATFS*, const UCHAR*, DWORD*, DWORD);    /* Get number of free clusters on the drive, limited */
+FRESULT l_countfree_step (FATFS*);                          /* Count free clusters, one FAT sector per call */
 
 #if _USE_STRFUNC
 #define feof(fp) ((fp)->fptr == (fp)->fsize)
@@ -346,6 +366,7 @@ DWORD get_fattime (void); /* 31-25: Year(0-127 org.1980), 24-21: Month(1-12), 20
 #define FA_OPEN_ALWAYS      0x10
 #define FA__WRITTEN         0x20
 #define FA__DIRTY           0x40
+#define FA__PREALLOC        0x10  /* Internal, FA_OPEN_ALWAYS is not stored */
 #endif
 #define FA__ERROR           0x80
 
@@ -31,11 +31,14 @@
 #include <string.h>
 #include "config.h"
 #include "buffers.h"
+#include "crc.h"
 #include "d64ops.h"
 #include "diskchange.h"
 #include "doscmd.h"
 #include "errormsg.h"
 #include "fastloader-ll.h"
+#include "fatops.h"
+#include "ff.h"
 #include "fileops.h"
 #include "iec-bus.h"
 #include "iec.h"
@@ -43,6 +46,7 @@
 #include "parser.h"
 #include "timer.h"
 #include "fastloader.h"
+#include "utils.h"
 #include "wrapops.h"
 
 
@@ -54,20 +58,163 @@
 #define SET_DATA_ACTIVE set_data(0);
 #define RELEASE_CLOCK_AND_DATA set_clock(1); set_data(1);
 
+// Number of vfile table entries uploaded by the scanner
+#define VFILE_COUNT 208
+
+// -------------------------------------------------------------
+// Offset table cache
+// -------------------------------------------------------------
+
+#ifdef CONFIG_LOADER_N0S_IFFL_CACHE
+
+// Identifies an IFFL container; stored at the start of each cache file,
+// followed by the translated start sector and start track tables
+typedef struct {
+  DWORD    image_cluster;  // start cluster of the image file
+  DWORD    image_size;     // size of the image file
+  uint8_t  label[17];      // disk label from the BAM
+  uint8_t  id[5];          // disk ID from the BAM
+  uint8_t  track;          // first track/sector of the container
+  uint8_t  sector;
+  uint16_t lba_crc;        // CRC of the uploaded vfile LBA tables
+} iffl_key_t;
+
+/** Build the cache key for the container that is about to be scanned.
+  * @key  : key structure to fill
+  * @lo/hi: uploaded vfile LBA tables
+  */
+static void iffl_build_key(iffl_key_t *key, uint8_t *lo, uint8_t *hi) {
+  path_t path;
+  uint16_t crc = 0xffff;
+  uint8_t i;
+
+  memset(key, 0, sizeof(iffl_key_t));
+  key->image_cluster = partition[current_part].imagehandle.org_clust;
+  key->image_size    = partition[current_part].imagehandle.fsize;
+  key->track         = d64_lastread.track;
+  key->sector        = d64_lastread.sector;
+
+  path.part = current_part;
+  path.dir  = partition[current_part].current_dir;
+  disk_label(current_part, key->label);
+  disk_id(&path, key->id);
+
+  for (i = 0; i < VFILE_COUNT; i++) {
+    crc = crc16_update(crc, lo[i]);
+    crc = crc16_update(crc, hi[i]);
+  }
+  key->lba_crc = crc;
+}
+
+/** Check that the cache files can be stored on partition 0.
+  * The partition must be a FAT file system, a mounted image does not
+  * matter because the cache files are accessed through FatFs directly.
+  */
+static bool iffl_cache_usable(void) {
+  if (max_part == 0 || partition[0].fatfs.fs_type == 0)
+    return false;
+
+  return partition[0].fop == &fatops || partition[0].fop == &d64ops;
+}
+
+/** Generate the name of the cache file for a key in ops_scratch.
+  * The name is derived from a CRC of the key, the key itself is stored
+  * in the file to detect collisions. The file is always in the root
+  * directory, independent of the current directory of partition 0.
+  */
+static void iffl_cache_name(iffl_key_t *key) {
+  uint16_t crc = 0xffff;
+  uint8_t *ptr = (uint8_t *)key;
+  uint8_t i;
+
+  for (i = 0; i < sizeof(iffl_key_t); i++)
+    crc = crc16_update(crc, *ptr++);
+
+  ptr = ops_scratch;
+  *ptr++ = '/';
+  *ptr++ = 'I';
+  *ptr++ = 'F';
+  *ptr++ = 'F';
+  *ptr++ = 'L';
+  ptr = byte_to_hex(crc >> 8, ptr);
+  ptr = byte_to_hex(crc & 0xff, ptr);
+  *ptr++ = '.';
+  *ptr++ = 'C';
+  *ptr++ = 'C';
+  *ptr++ = 'H';
+  *ptr   = 0;
+}
+
+/** Try to load the translated vfile tables from the cache.
+  * @key   : key of the current container
+  * @sector: vfile start sector table
+  * @track : vfile start track table
+  * @return true if the tables were loaded
+  */
+static bool iffl_cache_load(iffl_key_t *key, uint8_t *sector, uint8_t *track) {
+  iffl_key_t filekey;
+  FIL fh;
+  UINT bytesread;
+  bool found = false;
+
+  if (!iffl_cache_usable())
+    return false;
+
+  iffl_cache_name(key);
+  if (f_open(&partition[0].fatfs, &fh, ops_scratch, FA_READ | FA_OPEN_EXISTING) != FR_OK)
+    return false;
+
+  if (f_read(&fh, &filekey, sizeof(filekey), &bytesread) == FR_OK &&
+      bytesread == sizeof(filekey) &&
+      !memcmp(&filekey, key, sizeof(filekey))) {
+    // Read into the system buffers only after the key matched
+    if (f_read(&fh, sector, VFILE_COUNT, &bytesread) == FR_OK &&
+        bytesread == VFILE_COUNT &&
+        f_read(&fh, track, VFILE_COUNT, &bytesread) == FR_OK &&
+        bytesread == VFILE_COUNT)
+      found = true;
+  }
+
+  f_close(&fh);
+  return found;
+}
+
+/** Store the translated vfile tables in the cache.
+  * Errors are ignored, the tables are just rebuilt on the next boot.
+  */
+static void iffl_cache_store(iffl_key_t *key, uint8_t *sector, uint8_t *track) {
+  FIL fh;
+  UINT byteswritten;
+
+  if (!iffl_cache_usable())
+    return;
+
+  iffl_cache_name(key);
+  if (f_open(&partition[0].fatfs, &fh, ops_scratch, FA_WRITE | FA_CREATE_ALWAYS) != FR_OK)
+    return;
+
+  f_write(&fh, key, sizeof(iffl_key_t), &byteswritten);
+  f_write(&fh, sector, VFILE_COUNT, &byteswritten);
+  f_write(&fh, track, VFILE_COUNT, &byteswritten);
+  f_close(&fh);
+}
+#endif
+
 // -------------------------------------------------------------
 // Scanner routine
 // -------------------------------------------------------------
 
 void scan_n0s_iffl(UNUSED_PARAMETER) {
+#ifdef CONFIG_LOADER_N0S_IFFL_CACHE
+  iffl_key_t key;
+#endif
+
   // Only d64 images supported, exit otherwise
   if (partition[current_part].fop != &d64ops) {
     set_error(ERROR_IMAGE_INVALID);
     return;
   }
 
-  // Allocate 1 buffer for single sector reads
-  buffer_t *buf = alloc_system_buffer();
-
   // Vfile LBA tables LO/HI ($590/$660)
   // N0SDOS uploads a "vfile LBA" table with the starting sectors for each vfile
   // laid out as two actual uint8_t[208] tables. The scanner's job is to translate
@@ -80,6 +227,16 @@ void scan_n0s_iffl(UNUSED_PARAMETER) {
   uint8_t * const vfile_start_sector = vfile_lba_lo;
   uint8_t * const vfile_start_track  = vfile_lba_hi; 
 
+#ifdef CONFIG_LOADER_N0S_IFFL_CACHE
+  // Skip the chain scan if this container was translated before
+  iffl_build_key(&key, vfile_lba_lo, vfile_lba_hi);
+  if (iffl_cache_load(&key, vfile_start_sector, vfile_start_track))
+    return;
+#endif
+
+  // Allocate 1 buffer for single sector reads
+  buffer_t *buf = alloc_system_buffer();
+
   // C64 opens IFFL container and reads the first byte so that the scanner
   // can locate its first track/sector by looking at $18/$19
   uint8_t t = d64_lastread.track;
@@ -101,6 +258,10 @@ void scan_n0s_iffl(UNUSED_PARAMETER) {
     sector_count++;
   }
   free_buffer(buf);
+
+#ifdef CONFIG_LOADER_N0S_IFFL_CACHE
+  iffl_cache_store(&key, vfile_start_sector, vfile_start_track);
+#endif
 }
 
 
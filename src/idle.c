@@ -0,0 +1,176 @@
+/* sd2iec - SD/MMC to Commodore serial bus interface/controller
+   Copyright (C) 2007-2022  Ingo Korb <ingo@akana.de>
+
+   Inspired by MMC2IEC by Lars Pontoppidan et al.
+
+   FAT filesystem access based on code from ChaN and Jim Brain, see ff.c|h.
+
+   This program is free software; you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation; version 2 of the License only.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program; if not, write to the Free Software
+   Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+
+
+   idle.c: Background tasks run while the bus is idle
+
+*/
+
+#include <stdint.h>
+#include "config.h"
+#include "buffers.h"
+#include "d64ops.h"
+#include "diskchange.h"
+#include "diskio.h"
+#include "display.h"
+#include "ff.h"
+#include "filesystem.h"
+#include "led.h"
+#include "parser.h"
+#include "progmem.h"
+#include "sdcard.h"
+#include "timer.h"
+#include "uart.h"
+#include "idle.h"
+
+#ifdef CONFIG_LCD_DISPLAY
+#  include "lcd.h"
+#endif
+
+/*
+ * The bus main loops call idle_run while they wait for ATN. Every call
+ * runs at most one short slice of work (a single card access in most
+ * cases), ATN is acknowledged by its interrupt handler in the meantime.
+ * Anything that can be invalidated by a bus transaction is restarted
+ * by idle_start which is called whenever the bus becomes idle.
+ */
+
+#ifdef CONFIG_UART_DEBUG
+/* Set after the first idle_start since reset */
+static uint8_t bus_ready;
+#endif
+
+#if defined(CONFIG_LAZY_MOUNT) && defined(HAVE_HOTPLUG)
+/* Set after a mount attempt, cleared by idle_start */
+static uint8_t mount_tried;
+
+/**
+ * mount_step - mount a new card in the background
+ *
+ * This function mounts the file systems if the card has been changed
+ * (or was never mounted since reset) and no command was received since
+ * then. A failed attempt is not retried before the bus was busy again,
+ * the command handler of the bus will try again anyway.
+ * Returns 1 if the card was mounted, 0 if there is nothing to do.
+ */
+static uint8_t mount_step(void) {
+  if (disk_state != DISK_CHANGED || mount_tried)
+    return 0;
+
+  mount_tried = 1;
+  set_busy_led(1);
+  /* Same sequence as in the command handler of the bus */
+  free_multiple_buffers(FMB_ALL);
+  change_init();
+  filesystem_init(0);
+  update_leds();
+
+  return 1;
+}
+#endif
+
+/* Partition whose free clusters are counted */
+static uint8_t freecount_part;
+
+/**
+ * freecount_step - count the free clusters of the FAT partitions
+ *
+ * This function scans one FAT sector of the first partition whose
+ * number of free clusters is unknown, so the block count in the
+ * directory listing is available without a full FAT scan. The
+ * progress is kept in the file system, so the count continues where
+ * it stopped when the bus was busy.
+ * Returns 1 if a sector was scanned, 0 if there is nothing to do.
+ */
+static uint8_t freecount_step(void) {
+  while (freecount_part < max_part) {
+    FATFS *fs = &partition[freecount_part].fatfs;
+
+    if (fs->fs_type && fs->free_clust > fs->max_clust - 2) {
+      if (l_countfree_step(fs) != FR_OK)
+        /* failed, continue with the next partition */
+        freecount_part++;
+      return 1;
+    }
+
+    freecount_part++;
+  }
+
+  return 0;
+}
+
+/**
+ * idle_start - restart the background tasks
+ *
+ * This function must be called when the bus becomes idle and after
+ * any other action that may have changed the file system.
+ */
+void idle_start(void) {
+#ifdef CONFIG_UART_DEBUG
+  if (!bus_ready) {
+    /* Boot time in ticks, from reset until ATN can be answered */
+    tick_t now = getticks();
+
+    bus_ready = 1;
+    uart_puts_P(PSTR("ready after "));
+    uart_puthex(now >> 8);
+    uart_puthex(now & 0xff);
+    uart_putcrlf();
+  }
+#endif
+
+#if defined(CONFIG_LAZY_MOUNT) && defined(HAVE_HOTPLUG)
+  mount_tried = 0;
+#endif
+  freecount_part = 0;
+}
+
+/**
+ * idle_run - run one slice of background work
+ *
+ * This function runs the next pending background task for a short
+ * time. Returns 1 if some work was done, 0 if all tasks are idle
+ * so the caller can put the controller to sleep.
+ */
+uint8_t idle_run(void) {
+#ifdef CONFIG_LCD_DISPLAY
+  if (lcd_refresh())
+    return 1;
+#endif
+
+  if (display_queue_run())
+    return 1;
+
+#if defined(CONFIG_LAZY_MOUNT) && defined(HAVE_HOTPLUG)
+  if (mount_step())
+    return 1;
+#endif
+
+  if (d64_sync_idle())
+    return 1;
+
+  if (disk_flush_step())
+    return 1;
+
+  if (sd_speed_save_step())
+    return 1;
+
+  return freecount_step();
+}
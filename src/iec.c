@@ -45,9 +45,11 @@
 #include "fatops.h"
 #include "flags.h"
 #include "fileops.h"
+#include "idle.h"
 #include "filesystem.h"
 #include "iec-bus.h"
 #include "led.h"
+#include "stats.h"
 #include "system.h"
 #include "timer.h"
 #include "uart.h"
@@ -382,17 +384,109 @@ static uint8_t iec_listen_handler(const uint8_t cmd) {
 }
 
 /**
- * iec_talk_handler - handle an incoming TALK request (E909)
- * @cmd: command byte received from the bus
+ * count_sent - add bytes sent by talk_loop to the statistics
+ * @bytes: number of bytes
  *
- * This function handles a talk request from the computer.
+ * This function adds @bytes to the byte counter of the transfer
+ * protocol that is currently active.
  */
-static uint8_t iec_talk_handler(uint8_t cmd) {
-  buffer_t *buf;
+static void count_sent(uint16_t bytes) {
+  if (iec_data.iecflags & (JIFFY_ACTIVE | JIFFY_LOAD))
+    stats_add(STAT_BYTES_JIFFY, bytes);
+  else if (iec_data.iecflags & DOLPHIN_ACTIVE)
+    stats_add(STAT_BYTES_DOLPHIN, bytes);
+  else
+    stats_add(STAT_BYTES_STD, bytes);
+}
+
+/**
+ * read_ahead - read the next block of a channel into a spare buffer
+ * @ahead: spare buffer
+ * @buf  : channel buffer
+ *
+ * This function copies the channel buffer including its file state to
+ * @ahead and reads the next block there. The channel buffer itself
+ * keeps the block that is sent next, so it stays valid if the
+ * transfer is aborted. Returns 0 if successful, != 0 if the refill
+ * failed.
+ */
+static uint8_t read_ahead(buffer_t *ahead, buffer_t *buf) {
+  uint8_t *data = ahead->data;
+
+  memcpy(data, buf->data, 256);
+  *ahead = *buf;
+  ahead->data      = data;
+  ahead->secondary = BUFFER_SEC_SYSTEM;
+  ahead->dirty     = 0;
+  ahead->sticky    = 0;
+
+  return ahead->refill(ahead);
+}
+
+/**
+ * take_over - let the channel continue with the block read ahead
+ * @buf  : channel buffer
+ * @ahead: spare buffer filled by read_ahead
+ *
+ * This function moves the data and file state of @ahead, including
+ * its current position, to the channel buffer @buf. The data areas of
+ * both buffers are swapped, so @ahead can be used again afterwards.
+ */
+static void take_over(buffer_t *buf, buffer_t *ahead) {
+  uint8_t *data      = buf->data;
+  uint8_t  secondary = buf->secondary;
+  int      dirty     = buf->dirty;
+  int      sticky    = buf->sticky;
+
+  *buf = *ahead;
+  buf->secondary = secondary;
+  buf->dirty     = dirty;
+  buf->sticky    = sticky;
+
+  ahead->data      = data;
+  ahead->secondary = BUFFER_SEC_SYSTEM;
+  ahead->dirty     = 0;
+  ahead->sticky    = 0;
+}
+
+/**
+ * talk_end - account the sent bytes before talk_loop returns
+ * @chan: channel buffer
+ * @buf : buffer that was sent last
+ * @sent: number of bytes not yet added to the statistics
+ *
+ * This function adds @sent to the statistics and moves a block
+ * read ahead into the channel buffer if it was being sent, so the
+ * next TALK continues at the right position.
+ */
+static void talk_end(buffer_t *chan, buffer_t *buf, uint16_t sent) {
+  count_sent(sent);
+  if (buf != chan)
+    take_over(chan, buf);
+}
+
+/**
+ * talk_loop - send the contents of a channel to the computer
+ * @cmd  : command byte received from the bus
+ * @ahead: spare buffer for JiffyDOS LOAD read-ahead or NULL
+ *
+ * This function sends the data of the channel selected by @cmd to the
+ * computer until EOI is sent or ATN is asserted. If @ahead is not NULL,
+ * the JiffyDOS LOAD protocol reads the following block into @ahead
+ * before a block is sent. The block is then sent without the "next
+ * transfer will take some time" marker and the block in @ahead follows
+ * directly, so only every second block boundary has the slow refill
+ * handshake. The channel buffer only takes over the block in @ahead
+ * after the marker of that block was sent or on abort.
+ */
+static uint8_t talk_loop(uint8_t cmd, buffer_t *ahead) {
+  buffer_t *buf, *chan;
+  uint8_t   ahead_ready = 0;
+  uint16_t  sent = 0;
 
   uart_putc('T');
 
-  buf = find_buffer(cmd & 0x0f);
+  chan = buf = find_buffer(cmd & 0x0f);
   if (buf == NULL)
     return 0; /* 0 because we didn't change the state here */
 
@@ -419,6 +513,8 @@ static uint8_t iec_talk_handler(uint8_t cmd) {
   }
 
   while (buf->read) {
+    uint8_t first = buf->position;
+
     do {
       uint8_t finalbyte = (buf->position == buf->lastused);
       if (iec_data.iecflags & JIFFY_LOAD) {
@@ -430,9 +526,13 @@ static uint8_t iec_talk_handler(uint8_t cmd) {
         /* between two bytes outside the assembler function must not  */
         /* exceed ~38 C64 cycles (estimated) or the computer may      */
         /* see a previous data bit as the marker.                     */
-        if (jiffy_send(buf->data[buf->position],0,128 | !finalbyte)) {
+        /* A block is never the final one if its successor has been   */
+        /* read ahead because that one is already waiting in memory.  */
+        if (jiffy_send(buf->data[buf->position],0,
+                       128 | (!finalbyte || ahead_ready))) {
           /* Abort if ATN was seen */
           iec_check_atn();
+          talk_end(chan, buf, sent);
           return -1;
         }
 
@@ -464,6 +564,7 @@ static uint8_t iec_talk_handler(uint8_t cmd) {
           }
           if (res) {
             uart_putc('Q');
+            talk_end(chan, buf, sent);
             return 1;
           }
         } else {
@@ -475,12 +576,30 @@ static uint8_t iec_talk_handler(uint8_t cmd) {
 
           if (res) {
             uart_putc('V');
+            talk_end(chan, buf, sent);
             return 1;
           }
         }
       }
     } while (buf->position++ < buf->lastused);
 
+    /* The statistics are updated later, the block read ahead */
+    /* must follow within the byte gap timing.                */
+    sent += buf->lastused - first + 1;
+
+    if (ahead_ready) {
+      /* The next block has already been read, continue without pause */
+      ahead_ready = 0;
+      buf = ahead;
+      continue;
+    }
+
+    if (buf != chan) {
+      /* The block read ahead has been sent, the channel takes it over */
+      take_over(chan, buf);
+      buf = chan;
+    }
+
     if (buf->sendeoi &&
         (cmd & 0x0f) != 0x0f &&
         !buf->recordlen &&
@@ -489,13 +608,29 @@ static uint8_t iec_talk_handler(uint8_t cmd) {
       break;
     }
 
+    count_sent(sent);
+    sent = 0;
+
     if (buf->refill(buf)) {
       iec_data.bus_state = BUS_CLEANUP;
       return 1;
     }
 
     /* Search the buffer again, it can change when using large buffers */
-    buf = find_buffer(cmd & 0x0f);
+    chan = buf = find_buffer(cmd & 0x0f);
+
+    if (ahead != NULL &&
+        !buf->sendeoi &&
+        !buf->recordlen &&
+        buf->refill != directbuffer_refill) {
+      /* Read the following block now, so both can be sent with a  */
+      /* single handshake. If that fails, the new block is sent on */
+      /* its own and the refill of the channel reports the error.  */
+      if (read_ahead(ahead, buf))
+        ahead = NULL;
+      else
+        ahead_ready = 1;
+    }
 
     if (iec_data.iecflags & JIFFY_LOAD) {
       /* wait until the C64 is at FB06, use timeout in case the STOP key is pressed */
@@ -516,9 +651,31 @@ static uint8_t iec_talk_handler(uint8_t cmd) {
     }
   }
 
+  count_sent(sent);
   return 0;
 }
 
+/**
+ * iec_talk_handler - handle an incoming TALK request (E909)
+ * @cmd: command byte received from the bus
+ *
+ * This function handles a talk request from the computer.
+ */
+static uint8_t iec_talk_handler(uint8_t cmd) {
+#ifdef CONFIG_JIFFY_READAHEAD
+  if (iec_data.iecflags & JIFFY_LOAD) {
+    /* Use a spare buffer for read-ahead if one is available */
+    buffer_t *ahead = alloc_spare_buffer();
+    uint8_t res = talk_loop(cmd, ahead);
+
+    free_buffer(ahead);
+    return res;
+  }
+#endif
+
+  return talk_loop(cmd, NULL);
+}
+
 
 
 /* ------------------------------------------------------------------------- */
@@ -551,10 +708,14 @@ void iec_mainloop(void) {
   while (1) {
     switch (iec_data.bus_state) {
     case BUS_SLEEP:
+      d64_sync();
       set_atn_irq(0);
       set_data(1);
       set_clock(1);
-      set_error(ERROR_OK);
+      if (disk_flush() != RES_OK)
+        set_error(ERROR_WRITE_VERIFY);
+      else
+        set_error(ERROR_OK);
       set_busy_led(0);
       set_dirty_led(1);
 
@@ -572,9 +733,11 @@ void iec_mainloop(void) {
       /* Wait for ATN */
       parallel_set_dir(PARALLEL_DIR_IN);
       set_atn_irq(1);
+      idle_start();
       while (IEC_ATN) {
         if (key_pressed(KEY_NEXT | KEY_PREV | KEY_HOME)) {
           change_disk();
+          idle_start();
         } else if (key_pressed(KEY_SLEEP)) {
           reset_key(KEY_SLEEP);
           iec_data.bus_state = BUS_SLEEP;
@@ -582,8 +745,10 @@ void iec_mainloop(void) {
         } else if (display_found && key_pressed(KEY_DISPLAY)) {
           display_service();
           reset_key(KEY_DISPLAY);
+          idle_start();
         }
-        system_sleep();
+        if (!idle_run())
+          system_sleep();
       }
 
       if (iec_data.bus_state != BUS_SLEEP)
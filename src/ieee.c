@@ -41,6 +41,7 @@
 #include "doscmd.h"
 #include "fatops.h"
 #include "fileops.h"
+#include "idle.h"
 #include "filesystem.h"
 #include "led.h"
 #include "ieee.h"
@@ -49,6 +50,7 @@
 #include "ctype.h"
 #include "display.h"
 #include "system.h"
+#include "stats.h"
 
 /*
   Debug output:
@@ -347,27 +349,16 @@ int ieee_getc(void) {
 
 
 /**
- * ieee_putc - send a byte
- * @data    : byte to be sent
- * @with_eoi: Flags if the byte should be send with an EOI condition
+ * ieee_handshake - run the talker side of the handshake for one byte
  *
- * This function sends the byte data over the IEEE-488 bus and pulls
- * EOI if it is the last byte.
- * Returns
- *  0 normally,
- * ATN_POLLED if ATN was set or
- * TIMEOUT_ABORT if a timeout occured
- * On negative returns, the caller should return to the IEEE main loop.
+ * This function waits for the listeners to get ready, signals valid data
+ * and waits until all listeners accepted the byte. Each of the three
+ * phases has its own timeout.
+ * Returns 0 normally, ATN_POLLED if ATN was set or TIMEOUT_ABORT if a
+ * timeout occured.
  */
 
-static uint8_t ieee_putc(uint8_t data, const uint8_t with_eoi) {
-  ieee_ports_talk();
-  set_eoi_state (!with_eoi);
-  set_ieee_data (data);
-  if(!IEEE_ATN) return ATN_POLLED;
-  _delay_us(11);    /* Allow data to settle */
-  if(!IEEE_ATN) return ATN_POLLED;
-
+static inline uint8_t ieee_handshake(void) {
   /* Wait for NRFD high , check timeout */
   timeout = getticks() + MS_TO_TICKS(IEEE_TIMEOUT_MS);
   do {
@@ -393,6 +384,61 @@ static uint8_t ieee_putc(uint8_t data, const uint8_t with_eoi) {
   return 0;
 }
 
+/**
+ * ieee_putblock - send the remaining contents of a buffer
+ * @buf: pointer to the buffer
+ *
+ * This function sends all bytes from buf->position up to buf->lastused
+ * over the IEEE-488 bus and pulls EOI with the last byte if buf->sendeoi
+ * is set. The bus ports and EOI are only switched once per block.
+ * The bytes are counted as STAT_BYTES_STD, like the bytes sent with the
+ * standard IEC protocol.
+ * Returns
+ *  0 normally,
+ * ATN_POLLED if ATN was set or
+ * TIMEOUT_ABORT if a timeout occured
+ * On negative returns, the caller should return to the IEEE main loop.
+ * buf->position points to the unsent byte in this case.
+ */
+
+static uint8_t ieee_putblock(buffer_t *buf) {
+  uint8_t first = buf->position;
+  uint8_t finalbyte;
+  uint8_t res;
+
+  ieee_ports_talk();
+  set_eoi_state(1);
+
+  do {
+    finalbyte = (buf->position == buf->lastused);
+    if (finalbyte && buf->sendeoi)
+      set_eoi_state(0);
+    set_ieee_data(buf->data[buf->position]);
+    if(!IEEE_ATN) {
+      res = ATN_POLLED;
+      break;
+    }
+    _delay_us(11);    /* Allow data to settle */
+    if(!IEEE_ATN) {
+      res = ATN_POLLED;
+      break;
+    }
+
+    res = ieee_handshake();
+    if (res)
+      break;
+
+    buf->position++;
+  } while (!finalbyte);
+
+  if (res)
+    stats_add(STAT_BYTES_STD, (uint8_t)(buf->position - first));
+  else
+    stats_add(STAT_BYTES_STD, buf->lastused - first + 1);
+
+  return res;
+}
+
 /* ------------------------------------------------------------------------- */
 /*  Listen+Talk-Handling                                                     */
 /* ------------------------------------------------------------------------- */
@@ -482,40 +528,26 @@ static int16_t ieee_listen_handler (uint8_t cmd)
 static uint8_t ieee_talk_handler (void)
 {
   buffer_t *buf;
-  uint8_t finalbyte;
-  uint8_t c;
   uint8_t res;
 
   buf = find_buffer(ieee_data.secondary_address);
   if(buf == NULL) return -1;
 
   while (buf->read) {
-    do {
-      finalbyte = (buf->position == buf->lastused);
-      c = buf->data[buf->position];
-      if (finalbyte && buf->sendeoi) {
-        /* Send with EOI */
-        res = ieee_putc(c, 1);
-        if(!res) uart_puts_p("EOI: ");
-      } else {
-        /* Send without EOI */
-        res = ieee_putc(c, 0);
+    res = ieee_putblock(buf);
+    if(res) {
+      if(res==0xfc) {
+        uart_puts_P(PSTR("*** TIMEOUT ABORT***")); uart_putcrlf();
       }
-      if(res) {
-        if(res==0xfc) {
-          uart_puts_P(PSTR("*** TIMEOUT ABORT***")); uart_putcrlf();
-        }
-        if(res!=0xfd) {
-          uart_putc('c'); uart_puthex(res);
-        }
-        return 1;
-      } else {
-        uart_putc('>');
-        uart_puthex(c); uart_putc(' ');
-        if(isprint(c)) uart_putc(c); else uart_putc('?');
-        uart_putcrlf();
+      if(res!=0xfd) {
+        uart_putc('c'); uart_puthex(res);
       }
-    } while (buf->position++ < buf->lastused);
+      return 1;
+    }
+    uart_putc('>');
+    uart_puthex(buf->lastused);
+    if(buf->sendeoi) uart_puts_p(" EOI");
+    uart_putcrlf();
 
     if(buf->sendeoi && ieee_data.secondary_address != 0x0f &&
       !buf->recordlen && buf->refill != directbuffer_refill) {
@@ -582,9 +614,13 @@ void ieee_mainloop(void) {
   for(;;) {
     switch(ieee_data.bus_state) {
       case BUS_SLEEP:                               /* BUS_SLEEP */
+        d64_sync();
         set_atn_irq(0);
         ieee_bus_idle();
-        set_error(ERROR_OK);
+        if (disk_flush() != RES_OK)
+          set_error(ERROR_WRITE_VERIFY);
+        else
+          set_error(ERROR_OK);
         set_busy_led(0);
         uart_puts_P(PSTR("ieee.c/sleep ")); set_dirty_led(1);
 
@@ -601,9 +637,11 @@ void ieee_mainloop(void) {
 
       case BUS_IDLE:                                /* BUS_IDLE */
         ieee_bus_idle();
+        idle_start();
         while(IEEE_ATN) {   ;               /* wait for ATN */
           if (key_pressed(KEY_NEXT | KEY_PREV | KEY_HOME)) {
             change_disk();
+            idle_start();
           } else if (key_pressed(KEY_SLEEP)) {
             reset_key(KEY_SLEEP);
             ieee_data.bus_state = BUS_SLEEP;
@@ -611,8 +649,10 @@ void ieee_mainloop(void) {
           } else if (display_found && key_pressed(KEY_DISPLAY)) {
             display_service();
             reset_key(KEY_DISPLAY);
+            idle_start();
           }
-          system_sleep();
+          if (!idle_run())
+            system_sleep();
       }
 
       if (ieee_data.bus_state != BUS_SLEEP)
@@ -29,12 +29,19 @@ Title	:   HD44780U LCD library
 #include <inttypes.h>
 #include <avr/io.h>
 #include <avr/pgmspace.h>
+#include <string.h>
 #include <util/delay.h>
 #include "uart.h"
 #include "lcd.h"
 
 static uint8_t lcd_autodetect = 0;
 
+/* frame buffer, the characters shown on the display and the cursor */
+static char lcd_fb[LCD_LINES][LCD_FB_WIDTH];
+static char lcd_shown[LCD_LINES][LCD_FB_WIDTH];
+static uint8_t lcd_x, lcd_y;
+static uint8_t lcd_dirty;   /* bit n set: line n has changed */
+
 /*
 ** constants/macros
 */
@@ -309,48 +316,27 @@ static uint8_t lcd_waitbusy(void)
 
 
 /*************************************************************************
-Move cursor to the start of next line or to the first line if the cursor
-is already on the last line.
+DDRAM address of the first character of a line
 *************************************************************************/
-static inline void lcd_newline(uint8_t pos)
+static uint8_t lcd_line_start(uint8_t y)
 {
-    register uint8_t addressCounter;
-
-	if (lcd_autodetect)
-	{
 #if LCD_LINES==1
-    addressCounter = 0;
+    return LCD_START_LINE1;
 #endif
 #if LCD_LINES==2
-    if ( pos < (LCD_START_LINE2) )
-        addressCounter = LCD_START_LINE2;
-    else
-        addressCounter = LCD_START_LINE1;
+    return y ? LCD_START_LINE2 : LCD_START_LINE1;
 #endif
 #if LCD_LINES==4
-#if KS0073_4LINES_MODE
-    if ( pos < LCD_START_LINE2 )
-        addressCounter = LCD_START_LINE2;
-    else if ( (pos >= LCD_START_LINE2) && (pos < LCD_START_LINE3) )
-        addressCounter = LCD_START_LINE3;
-    else if ( (pos >= LCD_START_LINE3) && (pos < LCD_START_LINE4) )
-        addressCounter = LCD_START_LINE4;
-    else
-        addressCounter = LCD_START_LINE1;
-#else
-    if ( pos < LCD_START_LINE3 )
-        addressCounter = LCD_START_LINE2;
-    else if ( (pos >= LCD_START_LINE2) && (pos < LCD_START_LINE4) )
-        addressCounter = LCD_START_LINE3;
-    else if ( (pos >= LCD_START_LINE3) && (pos < LCD_START_LINE2) )
-        addressCounter = LCD_START_LINE4;
-    else
-        addressCounter = LCD_START_LINE1;
-#endif
+    if ( y==0 )
+        return LCD_START_LINE1;
+    else if ( y==1)
+        return LCD_START_LINE2;
+    else if ( y==2)
+        return LCD_START_LINE3;
+    else /* y==3 */
+        return LCD_START_LINE4;
 #endif
-    lcd_command((1<<LCD_DDRAM)+addressCounter);
-	}
-}/* lcd_newline */
+}/* lcd_line_start */
 
 
 /*
@@ -396,40 +382,38 @@ Returns:  none
 *************************************************************************/
 void lcd_gotoxy(uint8_t x, uint8_t y)
 {
-	if (lcd_autodetect)
-	{
+    lcd_x = x;
+    lcd_y = (y < LCD_LINES) ? y : LCD_LINES-1;
+}/* lcd_gotoxy */
 
-#if LCD_LINES==1
-    lcd_command((1<<LCD_DDRAM)+LCD_START_LINE1+x);
-#endif
-#if LCD_LINES==2
-    if ( y==0 )
-        lcd_command((1<<LCD_DDRAM)+LCD_START_LINE1+x);
-    else
-        lcd_command((1<<LCD_DDRAM)+LCD_START_LINE2+x);
-#endif
-#if LCD_LINES==4
-    if ( y==0 )
-        lcd_command((1<<LCD_DDRAM)+LCD_START_LINE1+x);
-    else if ( y==1)
-        lcd_command((1<<LCD_DDRAM)+LCD_START_LINE2+x);
-    else if ( y==2)
-        lcd_command((1<<LCD_DDRAM)+LCD_START_LINE3+x);
-    else /* y==3 */
-        lcd_command((1<<LCD_DDRAM)+LCD_START_LINE4+x);
-#endif
-	}
 
-}/* lcd_gotoxy */
+/*************************************************************************
+Set cursor to the position of a DDRAM address
+Input:    DDRAM address as sent with the "set DD RAM address" command
+Returns:  none
+*************************************************************************/
+void lcd_gotoaddr(uint8_t addr)
+{
+    uint8_t y, line = 0;
+
+    /* the line with the highest start address that is not above addr */
+    for (y = 1; y < LCD_LINES; y++)
+    {
+        if (lcd_line_start(y) <= addr && lcd_line_start(y) > lcd_line_start(line))
+            line = y;
+    }
+    lcd_gotoxy(addr - lcd_line_start(line), line);
+}/* lcd_gotoaddr */
 
 
 /*************************************************************************
+Returns the DDRAM address of the cursor
 *************************************************************************/
 int lcd_getxy(void)
 {
 	if (lcd_autodetect)
 	{
-		return lcd_waitbusy();
+		return lcd_line_start(lcd_y) + lcd_x;
 	}
 	return 0;
 }
@@ -440,10 +424,10 @@ Clear display and set cursor to home position
 *************************************************************************/
 void lcd_clrscr(void)
 {
-	if (lcd_autodetect)
-	{
-		lcd_command(1<<LCD_CLR);
-	}
+    memset(lcd_fb, ' ', sizeof(lcd_fb));
+    lcd_dirty = (1 << LCD_LINES) - 1;
+    lcd_x = 0;
+    lcd_y = 0;
 }
 
 
@@ -452,10 +436,8 @@ Set cursor to home position
 *************************************************************************/
 void lcd_home(void)
 {
-	if (lcd_autodetect)
-	{
-	    lcd_command(1<<LCD_HOME);
-	}
+    lcd_x = 0;
+    lcd_y = 0;
 }
 
 
@@ -466,47 +448,68 @@ Returns:  none
 *************************************************************************/
 void lcd_putc(char c)
 {
-    uint8_t pos;
-
-	if (lcd_autodetect)
-	{
-		pos = lcd_waitbusy();   // read busy-flag and address counter
-		if (c=='\n')
-		{
-			lcd_newline(pos);
-		}
-		else
-		{
-	#if LCD_WRAP_LINES==1
-	#if LCD_LINES==1
-			if ( pos == LCD_START_LINE1+LCD_DISP_LENGTH ) {
-				lcd_write((1<<LCD_DDRAM)+LCD_START_LINE1,0);
-			}
-	#elif LCD_LINES==2
-			if ( pos == LCD_START_LINE1+LCD_DISP_LENGTH ) {
-				lcd_write((1<<LCD_DDRAM)+LCD_START_LINE2,0);
-			}else if ( pos == LCD_START_LINE2+LCD_DISP_LENGTH ){
-				lcd_write((1<<LCD_DDRAM)+LCD_START_LINE1,0);
-			}
-	#elif LCD_LINES==4
-			if ( pos == LCD_START_LINE1+LCD_DISP_LENGTH ) {
-				lcd_write((1<<LCD_DDRAM)+LCD_START_LINE2,0);
-			}else if ( pos == LCD_START_LINE2+LCD_DISP_LENGTH ) {
-				lcd_write((1<<LCD_DDRAM)+LCD_START_LINE3,0);
-			}else if ( pos == LCD_START_LINE3+LCD_DISP_LENGTH ) {
-				lcd_write((1<<LCD_DDRAM)+LCD_START_LINE4,0);
-			}else if ( pos == LCD_START_LINE4+LCD_DISP_LENGTH ) {
-				lcd_write((1<<LCD_DDRAM)+LCD_START_LINE1,0);
-			}
-	#endif
-			lcd_waitbusy();
-	#endif
-			lcd_write(c, 1);
-		}
-	}
+    if (c=='\n')
+    {
+        /* move to the start of the next line */
+        lcd_x = 0;
+        if (++lcd_y >= LCD_LINES)
+            lcd_y = 0;
+    }
+    else if (lcd_x < LCD_FB_WIDTH)
+    {
+        /* characters beyond the end of the line are dropped */
+        if (lcd_fb[lcd_y][lcd_x] != c)
+        {
+            lcd_fb[lcd_y][lcd_x] = c;
+            lcd_dirty |= 1 << lcd_y;
+        }
+        lcd_x++;
+    }
 }/* lcd_putc */
 
 
+/*************************************************************************
+Send the changed characters of one line of the frame buffer to the LCD
+Returns:  1 if characters were sent, 0 if the display is up to date
+*************************************************************************/
+uint8_t lcd_refresh(void)
+{
+    uint8_t x, y, next;
+
+    if (!lcd_autodetect || !lcd_dirty)
+        return 0;
+
+    for (y = 0; !(lcd_dirty & (1 << y)); y++) ;
+    lcd_dirty &= ~(1 << y);
+
+    next = 0xff;
+    for (x = 0; x < LCD_FB_WIDTH; x++)
+    {
+        if (lcd_fb[y][x] == lcd_shown[y][x])
+            continue;
+
+        /* the address counter only needs to be set after a gap */
+        if (x != next)
+            lcd_command((1<<LCD_DDRAM) + lcd_line_start(y) + x);
+
+        lcd_data(lcd_fb[y][x]);
+        lcd_shown[y][x] = lcd_fb[y][x];
+        next = x + 1;
+    }
+
+    return 1;
+}/* lcd_refresh */
+
+
+/*************************************************************************
+Send all changes of the frame buffer to the LCD
+*************************************************************************/
+void lcd_flush(void)
+{
+    while (lcd_refresh()) ;
+}
+
+
 /*************************************************************************
 Display string without auto linefeed
 Input:    string to be displayed
@@ -703,7 +706,9 @@ void lcd_init(uint8_t dispAttr)
 	}
 	
 	lcd_command(LCD_DISP_OFF);              /* display off                  */
-    lcd_clrscr();                           /* display clear                */
+    lcd_command(1<<LCD_CLR);                /* display clear                */
+    memset(lcd_shown, ' ', sizeof(lcd_shown));
+    lcd_clrscr();
     lcd_command(LCD_MODE_DEFAULT);          /* set entry mode               */
     lcd_command(dispAttr);                  /* display/cursor control       */
 
@@ -78,6 +78,7 @@
 #define LCD_START_LINE3  0x14     /**< DDRAM address of first char of line 3 */
 #define LCD_START_LINE4  0x54     /**< DDRAM address of first char of line 4 */
 #define LCD_WRAP_LINES      0     /**< 0: no wrap, 1: wrap at end of visibile line */
+#define LCD_FB_WIDTH       20     /**< characters per line kept in the frame buffer */
 
 
 #define LCD_IO_MODE      1         /**< 0: memory mapped mode, 1: IO port mode */
@@ -309,6 +310,15 @@ extern void lcd_home(void);
 extern void lcd_gotoxy(uint8_t x, uint8_t y);
 
 
+/**
+ @brief    Set cursor to the position of a DDRAM address
+
+ @param    addr DDRAM address, the row offsets depend on LCD_LINES
+ @return   none
+*/
+extern void lcd_gotoaddr(uint8_t addr);
+
+
 /**
  @brief    Display character at current cursor position
  @param    c character to be displayed
@@ -362,6 +372,25 @@ extern void lcd_data(uint8_t data);
 extern uint8_t lcd_controller_type(void);
 
 
+/**
+ @brief    Send changed characters of one line of the frame buffer to the LCD
+
+ The text functions only update a frame buffer in RAM, this function
+ must be called regularly to transfer the changes to the display.
+ @param    none
+ @return   1 if characters were sent, 0 if the display is up to date
+*/
+extern uint8_t lcd_refresh(void);
+
+
+/**
+ @brief    Send all changes of the frame buffer to the LCD
+ @param    none
+ @return   none
+*/
+extern void lcd_flush(void);
+
+
 /**
  @brief macros for automatically storing string constant in program memory
 */
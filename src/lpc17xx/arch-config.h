@@ -49,6 +49,15 @@ typedef unsigned int rawbutton_t;
 #define SSP_CLK_DIVISOR_FAST 6
 #define SSP_CLK_DIVISOR_SLOW 250
 
+/* Limits for CONFIG_SD_AUTOSPEED - 50MHz high speed, 25MHz default speed, 4.2MHz */
+#define SSP_CLK_DIVISOR_HS   2
+#define SSP_CLK_DIVISOR_DS   4
+#define SSP_CLK_DIVISOR_MAX  24
+
+/* The SSP master is only specified up to about 33MHz, so 25MHz (divisor 4) */
+/* is the fastest clock used for cards in high speed mode too               */
+#define SSP_CLK_DIVISOR_MIN  4
+
 /* IEC in/out are always seperate */
 #define IEC_SEPARATE_OUT
 
@@ -43,6 +43,13 @@ void timer_init(void) {
   /* PCLK = CCLK */
   BITBAND(LPC_SC->PCLKSEL1, 26) = 1;
 
+#ifdef CONFIG_PROFILING
+  /* enable the cycle counter */
+  CORE_DEMCR |= BV(24);  // TRCENA
+  DWT_CYCCNT  = 0;
+  DWT_CTRL   |= BV(0);   // CYCCNTENA
+#endif
+
   /* enable SysTick */
   SysTick->LOAD = (SysTick->CALIB & 0xffffff) - 1;
   NVIC_SetPriority(SysTick_IRQn, NVIC_PRIORITY_LOWEST);
@@ -30,6 +30,29 @@
 typedef uint32_t tick_t;
 typedef int32_t stick_t;
 
+#ifdef CONFIG_PROFILING
+/* Cycle counter of the Cortex-M3 data watchpoint and trace unit */
+#define DWT_CTRL   (*(volatile uint32_t *)0xe0001000)
+#define DWT_CYCCNT (*(volatile uint32_t *)0xe0001004)
+#define CORE_DEMCR (*(volatile uint32_t *)0xe000edfc)
+
+/**
+ * cycle_count - return the number of CPU cycles since timer_init
+ */
+static inline uint32_t cycle_count(void) {
+  return DWT_CYCCNT;
+}
+
+/**
+ * cycle_diff - return the number of CPU cycles between two cycle counts
+ * @start: cycle count of the start
+ * @end  : cycle count of the end
+ */
+static inline uint32_t cycle_diff(uint32_t start, uint32_t end) {
+  return end - start;
+}
+#endif
+
 /* Delay functions */
 // FIXME: Is delay_us accurate enough as function?
 void delay_us(unsigned int time);
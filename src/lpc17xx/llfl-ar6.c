@@ -30,14 +30,11 @@
 #include "system.h"
 #include "timer.h"
 #include "fastloader-ll.h"
+#include "fastloader-timing.h"
 
 
-static const generic_2bit_t ar6_1581_send_def = {
-  .pairtimes = {50, 130, 210, 290},
-  .clockbits = {0, 2, 4, 6},
-  .databits  = {1, 3, 5, 7},
-  .eorvalue  = 0
-};
+static const generic_2bit_t ar6_1581_send_def =
+  FLT_GENERIC_2BIT(FLT_AR6_1581_SEND, 0);
 
 static const generic_2bit_t ar6_1581p_get_def = {
   .pairtimes = {120, 220, 380, 480},
@@ -58,8 +55,8 @@ void ar6_1581_send_byte(uint8_t byte) {
   llfl_generic_load_2bit(&ar6_1581_send_def, byte);
 
   /* exit with clock low, data high */
-  llfl_set_clock_at(375, 0, NO_WAIT);
-  llfl_set_data_at( 375, 1, WAIT);
+  llfl_set_clock_at(FLT_AR6_1581_SEND_EXIT, 0, NO_WAIT);
+  llfl_set_data_at( FLT_AR6_1581_SEND_EXIT, 1, WAIT);
 
   /* short delay to make sure bus has settled */
   delay_us(10);
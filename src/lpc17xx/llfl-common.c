@@ -309,14 +309,40 @@ uint32_t llfl_now(void) {
  * transmission based on a generic_2bit_t struct.
  */
 void llfl_generic_load_2bit(const generic_2bit_t *def, uint8_t byte) {
+  llfl_generic_load_2bit_block(def, &byte, 1, 0, 0);
+}
+
+/**
+ * llfl_generic_load_2bit_block - generic 2-bit fastloader block transmit
+ * @def      : pointer to fastloader definition struct
+ * @data     : pointer to the data bytes
+ * @count    : number of bytes to transmit
+ * @starttime: time of the first byte in 100ns after llfl_reference_time
+ * @bytetime : distance between two bytes in 100ns
+ *
+ * This function transmits a block of bytes without handshakes between
+ * them. All bit pairs are scheduled relative to a single reference
+ * time on the timer match outputs, so the pair timing of later bytes
+ * does not drift even if the CPU is delayed between two pairs.
+ * Returns the time after the last byte (starttime + count * bytetime).
+ */
+uint32_t llfl_generic_load_2bit_block(const generic_2bit_t *def, const uint8_t *data,
+                                      unsigned int count, uint32_t starttime,
+                                      uint32_t bytetime) {
   unsigned int i;
 
-  byte ^= def->eorvalue;
+  while (count--) {
+    uint8_t byte = *data++ ^ def->eorvalue;
 
-  for (i=0;i<4;i++) {
-    llfl_set_clock_at(def->pairtimes[i], byte & (1 << def->clockbits[i]), NO_WAIT);
-    llfl_set_data_at (def->pairtimes[i], byte & (1 << def->databits[i]),  WAIT);
+    for (i=0;i<4;i++) {
+      llfl_set_clock_at(starttime + def->pairtimes[i], byte & (1 << def->clockbits[i]), NO_WAIT);
+      llfl_set_data_at (starttime + def->pairtimes[i], byte & (1 << def->databits[i]),  WAIT);
+    }
+
+    starttime += bytetime;
   }
+
+  return starttime;
 }
 
 /**
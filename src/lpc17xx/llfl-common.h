@@ -51,6 +51,9 @@ void llfl_set_srq_at(uint32_t time, unsigned int state, llfl_wait_t wait);
 uint32_t llfl_read_bus_at(uint32_t time);
 uint32_t llfl_now(void);
 void llfl_generic_load_2bit(const generic_2bit_t *def, uint8_t byte);
+uint32_t llfl_generic_load_2bit_block(const generic_2bit_t *def, const uint8_t *data,
+                                      unsigned int count, uint32_t starttime,
+                                      uint32_t bytetime);
 uint8_t llfl_generic_save_2bit(const generic_2bit_t *def);
 
 #endif
@@ -44,9 +44,15 @@ void clk_data_handshake(void) {
   while (!IEC_DATA && IEC_ATN) ;
 }
 
+static const generic_2bit_t fc3_send_def = {
+  .pairtimes = {120, 240, 360, 480},
+  .clockbits = {0, 2, 4, 6},
+  .databits  = {1, 3, 5, 7},
+  .eorvalue  = 0
+};
+
 void fastloader_fc3_send_block(uint8_t *data) {
   uint32_t ticks;
-  unsigned int byte, pair;
 
   llfl_setup();
   disable_interrupts();
@@ -56,18 +62,7 @@ void fastloader_fc3_send_block(uint8_t *data) {
   llfl_set_clock_at(0, 0, WAIT);
 
   /* Transmit data */
-  ticks = 120;
-  for (byte = 0; byte < 4; byte++) {
-    uint8_t value = *data++;
-
-    for (pair = 0; pair < 4; pair++) {
-      llfl_set_clock_at(ticks, value & 1, NO_WAIT);
-      llfl_set_data_at (ticks, value & 2, WAIT);
-      value >>= 2;
-      ticks += 120;
-    }
-    ticks += 20;
-  }
+  ticks = llfl_generic_load_2bit_block(&fc3_send_def, data, 4, 0, 500) + 120;
 
   llfl_set_clock_at(ticks, 1, NO_WAIT);
   llfl_set_data_at (ticks, 1, WAIT);
@@ -29,6 +29,7 @@
 #include "llfl-common.h"
 #include "timer.h"
 #include "fastloader-ll.h"
+#include "fastloader-timing.h"
 
 
 /* ------------ */
@@ -90,12 +91,8 @@ static const generic_2bit_t geos_2mhz_send_def = {
   .eorvalue  = 0x0f
 };
 
-static const generic_2bit_t geos_1581_21_send_def = {
-  .pairtimes = {70, 140, 240, 330},
-  .clockbits = {0, 2, 4, 6},
-  .databits  = {1, 3, 5, 7},
-  .eorvalue  = 0
-};
+static const generic_2bit_t geos_1581_21_send_def =
+  FLT_GENERIC_2BIT(FLT_GEOS_1581_21_SEND, 0);
 
 static void geos_send_generic(uint8_t byte, const generic_2bit_t *timingdef, unsigned int holdtime_us) {
   llfl_setup();
@@ -176,12 +173,8 @@ static const generic_2bit_t wheels_1mhz_send_def = {
   .eorvalue  = 0xff
 };
 
-static const generic_2bit_t wheels44_2mhz_send_def = {
-  .pairtimes = {70, 150, 260, 370},
-  .clockbits = {0, 2, 4, 6},
-  .databits  = {1, 3, 5, 7},
-  .eorvalue  = 0
-};
+static const generic_2bit_t wheels44_2mhz_send_def =
+  FLT_GENERIC_2BIT(FLT_WHEELS44_2MHZ_SEND, 0);
 
 uint8_t wheels_send_byte_1mhz(uint8_t byte) {
   geos_send_generic(byte, &wheels_1mhz_send_def, 22);
@@ -30,13 +30,10 @@
 #include "system.h"
 #include "timer.h"
 #include "fastloader-ll.h"
+#include "fastloader-timing.h"
 
-static const generic_2bit_t n0sdos_send_def = {
-  .pairtimes = {90, 170, 250, 330},
-  .clockbits = {0, 2, 4, 6},
-  .databits  = {1, 3, 5, 7},
-  .eorvalue  = 0xff
-};
+static const generic_2bit_t n0sdos_send_def =
+  FLT_GENERIC_2BIT(FLT_N0SDOS_SEND, 0xff);
 
 void n0sdos_send_byte(uint8_t byte) {
   llfl_setup();
@@ -51,8 +48,8 @@ void n0sdos_send_byte(uint8_t byte) {
   llfl_generic_load_2bit(&n0sdos_send_def, byte);
 
   /* exit with clock high, data low */
-  llfl_set_clock_at(380, 1, NO_WAIT);
-  llfl_set_data_at( 380, 0, WAIT);
+  llfl_set_clock_at(FLT_N0SDOS_SEND_EXIT, 1, NO_WAIT);
+  llfl_set_data_at( FLT_N0SDOS_SEND_EXIT, 0, WAIT);
 
   /* C64 sets clock low at 42.5us, make sure we exit later than that */
   delay_us(6);
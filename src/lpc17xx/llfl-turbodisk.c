@@ -56,8 +56,14 @@ void turbodisk_byte(uint8_t value) {
   llfl_teardown();
 }
 
+static const generic_2bit_t turbodisk_buffer_def = {
+  .pairtimes = {360, 650, 940, 1230},
+  .clockbits = {7, 5, 3, 1},
+  .databits  = {6, 4, 2, 0},
+  .eorvalue  = 0
+};
+
 void turbodisk_buffer(uint8_t *data, uint8_t length) {
-  unsigned int pair;
   uint32_t ticks;
 
   llfl_setup();
@@ -67,22 +73,8 @@ void turbodisk_buffer(uint8_t *data, uint8_t length) {
   set_clock(1);
   llfl_wait_data(1, NO_ATNABORT);
 
-  ticks = 70;
-  while (length--) {
-    uint8_t byte = *data++;
-
-    ticks += 120;
-    for (pair = 0; pair < 4; pair++) {
-      ticks += 240;
-      llfl_set_clock_at(ticks, byte & 0x80, NO_WAIT);
-      llfl_set_data_at (ticks, byte & 0x40, WAIT);
-      ticks += 50;
-      byte <<= 2;
-    }
-    ticks += 100;
-  }
-
-  ticks += 110;
+  /* transmit data */
+  ticks = llfl_generic_load_2bit_block(&turbodisk_buffer_def, data, length, 70, 1380) + 110;
 
   llfl_set_clock_at(ticks, 0, NO_WAIT);
   llfl_set_data_at( ticks, 1, WAIT);
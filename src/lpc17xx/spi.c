@@ -23,6 +23,7 @@
 
 */
 
+#include <stdbool.h>
 #include "config.h"
 #include "lpc176x.h"
 #include "bitband.h"
@@ -50,6 +51,17 @@
 #  error "Unknown SSP unit specified!"
 #endif
 
+/* Source of the dummy bytes sent while receiving with DMA */
+static uint8_t dummy_ff = 0xff;
+
+/* State of the background receive started by spi_rx_start */
+static uint8_t      *rx_start;
+static unsigned int  rx_length;
+static bool          rx_active;
+
+/* Clock divisor used for SPI_SPEED_FAST */
+static uint8_t fast_divisor = SSP_CLK_DIVISOR_FAST;
+
 void spi_init(spi_speed_t speed) {
   /* Set clock prescaler to 1:1 */
   BITBAND(LPC_SC->SSP_PCLKREG, SSP_PCLKBIT) = 1;
@@ -59,7 +71,7 @@ void spi_init(spi_speed_t speed) {
 
   /* set clock prescaler */
   if (speed == SPI_SPEED_FAST) {
-    SSP_REGS->CPSR = SSP_CLK_DIVISOR_FAST;
+    SSP_REGS->CPSR = fast_divisor;
   } else {
     SSP_REGS->CPSR = SSP_CLK_DIVISOR_SLOW;
   }
@@ -108,10 +120,51 @@ void spi_tx_block(const void *ptr, unsigned int length) {
   }
 }
 
+void spi_tx_start(const void *ptr, unsigned int length) {
+  /* Clear interrupt flags of DMA channel 1 */
+  LPC_GPDMA->DMACIntTCClear = BV(1);
+  LPC_GPDMA->DMACIntErrClr  = BV(1);
+
+  /* Set up TX DMA channel */
+  LPC_GPDMACH1->DMACCSrcAddr  = (uint32_t)ptr;
+  LPC_GPDMACH1->DMACCDestAddr = (uint32_t)&SSP_REGS->DR;
+  LPC_GPDMACH1->DMACCLLI      = 0; // no linked list
+  LPC_GPDMACH1->DMACCControl  = length
+    | (0 << 12) // source burst size 1
+    | (0 << 15) // destination burst size 1
+    | (0 << 18) // source transfer width 1 byte
+    | (0 << 21) // destination transfer width 1 byte
+    | (1 << 26) // source address incremented
+    | (0 << 27) // destination address not incremented
+    ;
+  LPC_GPDMACH1->DMACCConfig = 1 // enable channel
+    | (SSP_DMAID_TX << 6) // data destination SSP TX
+    | (1 << 11) // transfer from memory to peripheral
+    ;
+
+  /* Enable TX FIFO DMA */
+  SSP_REGS->DMACR = 2;
+}
+
+void spi_tx_wait(void) {
+  /* Wait until DMA channel disables itself */
+  while (LPC_GPDMACH1->DMACCConfig & 1) ;
+
+  /* Disable TX FIFO DMA */
+  SSP_REGS->DMACR = 0;
+}
+
 void spi_rx_block(void *ptr, unsigned int length) {
   uint8_t *data = (uint8_t *)ptr;
   unsigned int txlen = length;
 
+  if ((length & 3) == 0 && ((uint32_t)ptr & 3) == 0) {
+    /* Aligned, use DMA */
+    spi_rx_start(ptr, length);
+    while (spi_rx_done() < length) ;
+    return;
+  }
+
   /* Wait until SSP is not busy */
   while (BITBAND(SSP_REGS->SR, SSP_BSY)) ;
 
@@ -119,64 +172,108 @@ void spi_rx_block(void *ptr, unsigned int length) {
   while (BITBAND(SSP_REGS->SR, SSP_RNE))
     (void) SSP_REGS->DR;
 
-  if ((length & 3) != 0 || ((uint32_t)ptr & 3) != 0) {
-    /* Odd length or unaligned buffer */
-    while (length > 0) {
-      /* Wait until TX or RX FIFO are ready */
-      while (txlen > 0 && !BITBAND(SSP_REGS->SR, SSP_TNF) &&
-             !BITBAND(SSP_REGS->SR, SSP_RNE)) ;
-
-      /* Try to receive data */
-      while (length > 0 && BITBAND(SSP_REGS->SR, SSP_RNE)) {
-        *data++ = SSP_REGS->DR;
-        length--;
-      }
-
-      /* Send dummy data until TX full or RX ready */
-      while (txlen > 0 && BITBAND(SSP_REGS->SR, SSP_TNF) && !BITBAND(SSP_REGS->SR, SSP_RNE)) {
-        txlen--;
-        SSP_REGS->DR = 0xff;
-      }
+  /* Odd length or unaligned buffer */
+  while (length > 0) {
+    /* Wait until TX or RX FIFO are ready */
+    while (txlen > 0 && !BITBAND(SSP_REGS->SR, SSP_TNF) &&
+           !BITBAND(SSP_REGS->SR, SSP_RNE)) ;
+
+    /* Try to receive data */
+    while (length > 0 && BITBAND(SSP_REGS->SR, SSP_RNE)) {
+      *data++ = SSP_REGS->DR;
+      length--;
     }
-  } else {
-    /* Clear interrupt flags of DMA channels 0 */
-    LPC_GPDMA->DMACIntTCClear = BV(0);
-    LPC_GPDMA->DMACIntErrClr  = BV(0);
-
-    /* Set up RX DMA channel */
-    LPC_GPDMACH0->DMACCSrcAddr  = (uint32_t)&SSP_REGS->DR;
-    LPC_GPDMACH0->DMACCDestAddr = (uint32_t)ptr;
-    LPC_GPDMACH0->DMACCLLI      = 0; // no linked list
-    LPC_GPDMACH0->DMACCControl  = length
-      | (0 << 12) // source burst size 1
-      | (0 << 15) // destination burst size 1
-      | (0 << 18) // source transfer width 1 byte
-      | (2 << 21) // destination transfer width 4 bytes
-      | (0 << 26) // source address not incremented
-      | (1 << 27) // destination address incremented
-      ;
-    LPC_GPDMACH0->DMACCConfig = 1 // enable channel
-      | (SSP_DMAID_RX << 1) // data source SSP RX
-      | (2 << 11) // transfer from peripheral to memory
-      ;
-
-    /* Enable RX FIFO DMA */
-    SSP_REGS->DMACR = 1;
-
-    /* Write <length> bytes into TX FIFO */
-    while (txlen > 0) {
-      while (txlen > 0 && BITBAND(SSP_REGS->SR, SSP_TNF)) {
-        txlen--;
-        SSP_REGS->DR = 0xff;
-      }
+
+    /* Send dummy data until TX full or RX ready */
+    while (txlen > 0 && BITBAND(SSP_REGS->SR, SSP_TNF) && !BITBAND(SSP_REGS->SR, SSP_RNE)) {
+      txlen--;
+      SSP_REGS->DR = 0xff;
     }
+  }
+}
 
-    /* Wait until DMA channel disables itself */
+void spi_rx_start(void *ptr, unsigned int length) {
+  rx_start  = ptr;
+  rx_length = length;
+
+  if ((length & 3) != 0 || ((uint32_t)ptr & 3) != 0) {
+    /* Odd length or unaligned buffer, receive it right now */
+    rx_active = false;
+    spi_rx_block(ptr, length);
+    return;
+  }
+
+  /* Wait until SSP is not busy */
+  while (BITBAND(SSP_REGS->SR, SSP_BSY)) ;
+
+  /* Clear RX fifo */
+  while (BITBAND(SSP_REGS->SR, SSP_RNE))
+    (void) SSP_REGS->DR;
+
+  /* Clear interrupt flags of DMA channels 0 and 1 */
+  LPC_GPDMA->DMACIntTCClear = BV(0) | BV(1);
+  LPC_GPDMA->DMACIntErrClr  = BV(0) | BV(1);
+
+  /* Set up RX DMA channel */
+  LPC_GPDMACH0->DMACCSrcAddr  = (uint32_t)&SSP_REGS->DR;
+  LPC_GPDMACH0->DMACCDestAddr = (uint32_t)ptr;
+  LPC_GPDMACH0->DMACCLLI      = 0; // no linked list
+  LPC_GPDMACH0->DMACCControl  = length
+    | (0 << 12) // source burst size 1
+    | (0 << 15) // destination burst size 1
+    | (0 << 18) // source transfer width 1 byte
+    | (2 << 21) // destination transfer width 4 bytes
+    | (0 << 26) // source address not incremented
+    | (1 << 27) // destination address incremented
+    ;
+  LPC_GPDMACH0->DMACCConfig = 1 // enable channel
+    | (SSP_DMAID_RX << 1) // data source SSP RX
+    | (2 << 11) // transfer from peripheral to memory
+    ;
+
+  /* Set up TX DMA channel for the dummy bytes */
+  LPC_GPDMACH1->DMACCSrcAddr  = (uint32_t)&dummy_ff;
+  LPC_GPDMACH1->DMACCDestAddr = (uint32_t)&SSP_REGS->DR;
+  LPC_GPDMACH1->DMACCLLI      = 0; // no linked list
+  LPC_GPDMACH1->DMACCControl  = length
+    | (0 << 12) // source burst size 1
+    | (0 << 15) // destination burst size 1
+    | (0 << 18) // source transfer width 1 byte
+    | (0 << 21) // destination transfer width 1 byte
+    | (0 << 26) // source address not incremented
+    | (0 << 27) // destination address not incremented
+    ;
+  LPC_GPDMACH1->DMACCConfig = 1 // enable channel
+    | (SSP_DMAID_TX << 6) // data destination SSP TX
+    | (1 << 11) // transfer from memory to peripheral
+    ;
+
+  /* Enable RX and TX FIFO DMA, the channel numbers give RX priority */
+  rx_active = true;
+  SSP_REGS->DMACR = 3;
+}
+
+unsigned int spi_rx_done(void) {
+  unsigned int done;
+
+  if (rx_active) {
+    if (LPC_GPDMACH0->DMACCConfig & 1) {
+      /* Everything below the destination address has been written */
+      done = LPC_GPDMACH0->DMACCDestAddr - (uint32_t)rx_start;
+      if (done < rx_length)
+        return done;
+    }
+
+    /* Wait until both DMA channels disable themselves */
     while (LPC_GPDMACH0->DMACCConfig & 1) ;
+    while (LPC_GPDMACH1->DMACCConfig & 1) ;
 
-    /* Disable RX FIFO DMA */
+    /* Disable RX and TX FIFO DMA */
     SSP_REGS->DMACR = 0;
+    rx_active = false;
   }
+
+  return rx_length;
 }
 
 void spi_set_speed(spi_speed_t speed) {
@@ -188,7 +285,7 @@ void spi_set_speed(spi_speed_t speed) {
 
   /* Change clock divisor */
   if (speed == SPI_SPEED_FAST) {
-    SSP_REGS->CPSR = SSP_CLK_DIVISOR_FAST;
+    SSP_REGS->CPSR = fast_divisor;
   } else {
     SSP_REGS->CPSR = SSP_CLK_DIVISOR_SLOW;
   }
@@ -197,6 +294,10 @@ void spi_set_speed(spi_speed_t speed) {
   SSP_REGS->CR1 = BV(1);
 }
 
+void spi_set_fast_divisor(uint8_t divisor) {
+  fast_divisor = divisor;
+}
+
 void spi_select_device(spi_device_t dev) {
   /* Wait until TX fifo is empty */
   while (!BITBAND(SSP_REGS->SR, 0)) ;
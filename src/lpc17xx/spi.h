@@ -53,7 +53,25 @@ uint8_t spi_rx_byte(void);
 /* Receive a data block */
 void spi_rx_block(void *data, unsigned int length);
 
+/* Background transfers with DMA, used to overlap the SD card CRC calculation */
+#define HAVE_SPI_BACKGROUND
+
+/* Start transmitting a data block */
+void spi_tx_start(const void *data, unsigned int length);
+
+/* Wait until the data block is in the TX FIFO */
+void spi_tx_wait(void);
+
+/* Start receiving a data block */
+void spi_rx_start(void *data, unsigned int length);
+
+/* Number of bytes already received, returns length when done */
+unsigned int spi_rx_done(void);
+
 /* Switch speed of SPI interface */
 void spi_set_speed(spi_speed_t speed);
 
+/* Set the clock divisor used for SPI_SPEED_FAST (even, 2-254) */
+void spi_set_fast_divisor(uint8_t divisor);
+
 #endif
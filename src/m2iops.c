@@ -23,6 +23,7 @@
 
 */
 
+#include <stdbool.h>
 #include <stdint.h>
 #include <string.h>
 #include "config.h"
@@ -45,6 +46,31 @@
 #define M2I_FATNAME_OFFSET 2
 #define M2I_FATNAME_LEN    12
 
+#ifdef CONFIG_M2I_INDEX
+
+/* Special values of the type field of an index entry */
+#define M2I_FREE           0xff  /* deleted entry, can be reused */
+#define M2I_HIDDEN         0xfe  /* unknown type or missing file */
+
+/* Marks sizes that must be read from the FAT file */
+#define M2I_SIZE_UNKNOWN   0xffff
+
+/* index_count value if the M2I file does not fit into the index */
+#define M2I_INDEX_OVERFLOW 0xffff
+
+typedef struct {
+  uint8_t  type;
+  uint8_t  remainder;
+  uint16_t blocksize;
+  uint8_t  name[CBM_NAME_LENGTH];
+} m2i_index_t;
+
+static m2i_index_t m2i_index[CONFIG_M2I_INDEX_SIZE];
+static uint8_t     index_part = -1;
+static uint16_t    index_count;
+
+#endif
+
 /* ------------------------------------------------------------------------- */
 /*  Utility functions                                                        */
 /* ------------------------------------------------------------------------- */
@@ -126,6 +152,232 @@ static uint8_t load_entry(uint8_t part, uint16_t offset) {
   return 0;
 }
 
+/**
+ * read_entry - read an M2I entry into a cbmdirent
+ * @part  : partition number
+ * @offset: offset in M2I file of the entry
+ * @dent  : pointer to cbmdirent struct to be filled
+ *
+ * This function reads the M2I line at offset and fills dent with the
+ * type, name and size of the file it describes. The time stamp is not
+ * set. Returns 0 if successful, 1 at end of file, 2 for a deleted
+ * entry, 3 for an entry that should not be shown or 255 on error.
+ */
+static uint8_t read_entry(uint8_t part, uint16_t offset, cbmdirent_t *dent) {
+  uint8_t i;
+
+  i = load_entry(part, offset);
+  if (i)
+    return i;
+
+  memset(dent, 0, sizeof(cbmdirent_t));
+  dent->pvt.m2i.offset = offset;
+
+  if (ops_scratch[0] == '-')
+    return 2;
+
+  /* Check file type */
+  if (parsetype())
+    return 3;
+
+  dent->opstype   = OPSTYPE_M2I;
+  dent->typeflags = ops_scratch[0];
+
+  /* Copy CBM file name */
+  name_repad(' ', 0);
+  memcpy(dent->name, ops_scratch + M2I_CBMNAME_OFFSET, CBM_NAME_LENGTH);
+
+  /* Get file size */
+  if (dent->typeflags != TYPE_DEL) {
+    /* Let's annoy some users */
+    FILINFO finfo;
+
+    FRESULT res = f_stat(&partition[part].fatfs, ops_scratch + M2I_FATNAME_OFFSET, &finfo);
+    if (res != FR_OK) {
+      if (res == FR_NO_FILE)
+        return 3;
+      else {
+        parse_error(res,1);
+        return 255;
+      }
+    }
+
+    if (finfo.fsize > 16255746)
+      /* File too large -> size 63999 blocks */
+      dent->blocksize = 63999;
+    else
+      dent->blocksize = (finfo.fsize+253) / 254;
+
+    dent->remainder = finfo.fsize % 254;
+  } else
+    dent->blocksize = 0;
+
+  return 0;
+}
+
+#ifdef CONFIG_M2I_INDEX
+/**
+ * m2i_index_invalidate - forget the contents of the M2I index
+ *
+ * This function must be called when a new M2I file is mounted.
+ */
+void m2i_index_invalidate(void) {
+  index_part = -1;
+}
+
+/**
+ * index_valid - make sure the M2I index is usable
+ * @part: partition number
+ *
+ * This function reads all entries of the M2I file mounted on part
+ * into the index unless that has already been done. Returns true
+ * if the index can be used, false if the file must be read instead.
+ */
+static bool index_valid(uint8_t part) {
+  cbmdirent_t dent;
+  m2i_index_t *entry;
+  uint16_t pos;
+  uint8_t i;
+
+  if (part == index_part)
+    return index_count != M2I_INDEX_OVERFLOW;
+
+  index_part  = -1;
+  index_count = 0;
+  pos = M2I_ENTRY_OFFSET;
+
+  while (1) {
+    i = read_entry(part, pos, &dent);
+    if (i == 1)
+      break;
+
+    if (i == 255)
+      /* Try again next time, the caller will see the error */
+      return false;
+
+    if (index_count == CONFIG_M2I_INDEX_SIZE) {
+      /* Too many entries, don't try again until the next mount */
+      index_count = M2I_INDEX_OVERFLOW;
+      break;
+    }
+
+    entry = m2i_index + index_count++;
+    if (i == 2)
+      entry->type = M2I_FREE;
+    else if (i == 3)
+      entry->type = M2I_HIDDEN;
+    else
+      entry->type = dent.typeflags;
+
+    entry->blocksize = dent.blocksize;
+    entry->remainder = dent.remainder;
+    memcpy(entry->name, dent.name, CBM_NAME_LENGTH);
+
+    pos += M2I_ENTRY_LEN;
+  }
+
+  index_part = part;
+  return index_count != M2I_INDEX_OVERFLOW;
+}
+
+/**
+ * index_entry - get the index entry for an M2I offset
+ * @part  : partition number
+ * @offset: offset in M2I file of the entry
+ *
+ * This function returns a pointer to the index entry of the M2I line
+ * at offset or NULL if the index is not used or has no such entry.
+ */
+static m2i_index_t *index_entry(uint8_t part, uint16_t offset) {
+  uint16_t slot = (offset - M2I_ENTRY_OFFSET) / M2I_ENTRY_LEN;
+
+  if (part != index_part || index_count == M2I_INDEX_OVERFLOW ||
+      slot >= index_count)
+    return NULL;
+
+  return m2i_index + slot;
+}
+
+/**
+ * read_index - read an M2I entry from the index into a cbmdirent
+ * @part  : partition number
+ * @offset: offset in M2I file of the entry
+ * @dent  : pointer to cbmdirent struct to be filled
+ *
+ * This function is the same as read_entry, but uses the index instead
+ * of the M2I file if possible.
+ */
+static uint8_t read_index(uint8_t part, uint16_t offset, cbmdirent_t *dent) {
+  m2i_index_t *entry;
+
+  if (!index_valid(part))
+    return read_entry(part, offset, dent);
+
+  entry = index_entry(part, offset);
+  if (entry == NULL)
+    return 1;
+
+  if (entry->type == M2I_FREE)
+    return 2;
+
+  if (entry->type == M2I_HIDDEN)
+    return 3;
+
+  if (entry->blocksize == M2I_SIZE_UNKNOWN)
+    /* Written since the index was built, the size must be checked */
+    return read_entry(part, offset, dent);
+
+  memset(dent, 0, sizeof(cbmdirent_t));
+  dent->pvt.m2i.offset = offset;
+  dent->opstype   = OPSTYPE_M2I;
+  dent->typeflags = entry->type;
+  dent->blocksize = entry->blocksize;
+  dent->remainder = entry->remainder;
+  memcpy(dent->name, entry->name, CBM_NAME_LENGTH);
+
+  return 0;
+}
+
+/**
+ * index_update - update an M2I index entry
+ * @part  : partition number
+ * @offset: offset in M2I file of the entry
+ * @type  : new type of the entry
+ * @name  : new CBM name of the entry or NULL to keep it
+ *
+ * This function updates the index after the M2I entry at offset
+ * was changed. The size of the entry is set to unknown because
+ * the file may have been written.
+ */
+static void index_update(uint8_t part, uint16_t offset, uint8_t type, uint8_t *name) {
+  m2i_index_t *entry;
+
+  if (part != index_part || index_count == M2I_INDEX_OVERFLOW)
+    return;
+
+  if (offset == M2I_ENTRY_OFFSET + index_count * M2I_ENTRY_LEN) {
+    /* New entry at the end of the file */
+    if (index_count == CONFIG_M2I_INDEX_SIZE) {
+      index_count = M2I_INDEX_OVERFLOW;
+      return;
+    }
+    index_count++;
+  }
+
+  entry = index_entry(part, offset);
+  if (entry == NULL)
+    return;
+
+  entry->type      = type;
+  entry->blocksize = M2I_SIZE_UNKNOWN;
+  if (name != NULL)
+    ustrncpy(entry->name, name, CBM_NAME_LENGTH);
+}
+#else
+#  define read_index(p,o,d) read_entry(p,o,d)
+#  define index_update(p,o,t,n) do {} while (0)
+#endif
+
 /**
  * find_empty_entry - returns the offset of the first empty M2I entry
  * @part: partition number
@@ -139,6 +391,18 @@ static uint16_t find_empty_entry(uint8_t part) {
   uint16_t pos = M2I_ENTRY_OFFSET;
   uint8_t i;
 
+#ifdef CONFIG_M2I_INDEX
+  if (index_valid(part)) {
+    m2i_index_t *entry = m2i_index;
+
+    while (entry < m2i_index + index_count && entry->type != M2I_FREE) {
+      entry++;
+      pos += M2I_ENTRY_LEN;
+    }
+    return pos;
+  }
+#endif
+
   while (1) {
     i = load_entry(part, pos);
 
@@ -169,7 +433,9 @@ static uint16_t find_empty_entry(uint8_t part) {
  * the appropiate fat_* functions.
  */
 static void open_existing(path_t *path, cbmdirent_t *dent, uint8_t type, buffer_t *buf, uint8_t appendflag) {
-  if (load_entry(path->part, dent->pvt.m2i.offset)) {
+  uint16_t offset = dent->pvt.m2i.offset;
+
+  if (load_entry(path->part, offset)) {
     set_error(ERROR_FILE_NOT_FOUND);
     return;
   }
@@ -181,9 +447,10 @@ static void open_existing(path_t *path, cbmdirent_t *dent, uint8_t type, buffer_
 
   ustrcpy(dent->pvt.fat.realname, ops_scratch + M2I_FATNAME_OFFSET);
 
-  if (appendflag)
+  if (appendflag) {
+    index_update(path->part, offset, ops_scratch[0], NULL);
     fat_open_write(path, dent, type, buf, 1);
-  else
+  } else
     fat_open_read(path, dent, buf);
 }
 
@@ -201,55 +468,18 @@ static int8_t m2i_readdir(dh_t *dh, cbmdirent_t *dent) {
   uint8_t i;
 
   while (1) {
-    i = load_entry(dh->part, dh->dir.m2i);
-    if (i) {
-      if (i == 255)
-        return 1;
-      else
-        return -1;
-    }
-
-    memset(dent, 0, sizeof(cbmdirent_t));
-    dent->pvt.m2i.offset = dh->dir.m2i;
+    i = read_index(dh->part, dh->dir.m2i, dent);
+    if (i == 1)
+      return -1;
+    if (i == 255)
+      return 1;
 
     dh->dir.m2i += M2I_ENTRY_LEN;
 
-    /* Check file type */
-    if (parsetype())
+    /* Skip deleted and invalid entries */
+    if (i)
       continue;
 
-    dent->opstype   = OPSTYPE_M2I;
-    dent->typeflags = ops_scratch[0];
-
-    /* Copy CBM file name */
-    name_repad(' ', 0);
-    memcpy(dent->name, ops_scratch + M2I_CBMNAME_OFFSET, CBM_NAME_LENGTH);
-
-    /* Get file size */
-    if (dent->typeflags != TYPE_DEL) {
-      /* Let's annoy some users */
-      FILINFO finfo;
-
-      FRESULT res = f_stat(&partition[dh->part].fatfs, ops_scratch + M2I_FATNAME_OFFSET, &finfo);
-      if (res != FR_OK) {
-        if (res == FR_NO_FILE)
-          continue;
-        else {
-          parse_error(res,1);
-          return 1;
-        }
-      }
-
-      if (finfo.fsize > 16255746)
-        /* File too large -> size 63999 blocks */
-        dent->blocksize = 63999;
-      else
-        dent->blocksize = (finfo.fsize+253) / 254;
-
-      dent->remainder = finfo.fsize % 254;
-    } else
-      dent->blocksize = 0;
-
     /* Fake Date/Time */
     dent->date.year  = 82;
     dent->date.month = 8;
@@ -380,7 +610,9 @@ static void m2i_open_write(path_t *path, cbmdirent_t *dent, uint8_t type, buffer
       /* No error checking here. Either it works or everything has failed. */
       ops_scratch[0] = '-';
       image_write(path->part, offset, ops_scratch, 1, 1);
-    }
+      index_update(path->part, offset, M2I_FREE, NULL);
+    } else
+      index_update(path->part, offset, type & TYPE_MASK, dent->name);
   }
 }
 
@@ -408,13 +640,15 @@ static uint8_t m2i_delete(path_t *path, cbmdirent_t *dent) {
   ops_scratch[0] = '-';
   if (image_write(path->part, offset, ops_scratch, 1, 1))
     return 0;
-  else
-    return 1;
+
+  index_update(path->part, offset, M2I_FREE, NULL);
+  return 1;
 }
 
 static void m2i_rename(path_t *path, cbmdirent_t *dent, uint8_t *newname) {
   uint16_t offset;
   uint8_t *ptr;
+  uint8_t i;
 
   set_busy_led(1);
   /* Locate entry in the M2I file */
@@ -431,11 +665,12 @@ static void m2i_rename(path_t *path, cbmdirent_t *dent, uint8_t *newname) {
   /* Copy the new filename */
   ptr = ops_scratch + M2I_CBMNAME_OFFSET;
   memset(ptr, ' ', CBM_NAME_LENGTH);
-  while (*newname)
-    *ptr++ = *newname++;
+  for (i = 0; newname[i]; i++)
+    *ptr++ = newname[i];
 
   /* Write new entry */
-  image_write(path->part, offset, ops_scratch, M2I_ENTRY_LEN, 1);
+  if (!image_write(path->part, offset, ops_scratch, M2I_ENTRY_LEN, 1))
+    index_update(path->part, offset, dent->typeflags, newname);
 
   update_leds();
 }
@@ -30,4 +30,10 @@
 
 extern const fileops_t m2iops;
 
+#ifdef CONFIG_M2I_INDEX
+void m2i_index_invalidate(void);
+#else
+#  define m2i_index_invalidate() do {} while (0)
+#endif
+
 #endif
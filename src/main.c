@@ -94,7 +94,12 @@ int main(void) {
   DS_INIT;
 #endif
 
+#if defined(CONFIG_LAZY_MOUNT) && defined(HAVE_HOTPLUG)
+  /* Mount the card later, the bus loop can answer ATN in the meantime */
+  disk_state = DISK_CHANGED;
+#else
   filesystem_init(0);
+#endif
   change_init();
 
   uart_puts_P(PSTR("\r\nsd2iec " VERSION " #"));
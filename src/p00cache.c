@@ -29,6 +29,7 @@
 #include "config.h"
 #include "dirent.h"
 #include "p00cache.h"
+#include "stats.h"
 
 #include "uart.h"
 
@@ -48,17 +49,22 @@ void p00cache_invalidate(void) {
 
 uint8_t *p00cache_lookup(uint8_t part, uint32_t cluster) {
   /* fail if it's for a different partition */
-  if (part != cache_part)
+  if (part != cache_part) {
+    stats_inc(STAT_P00CACHE_MISSES);
     return NULL;
+  }
 
   /* linear search for the correct cluster number */
   /* (binary search was only 6-8% faster overall) */
   for (unsigned int i=0; i<entries; i++) {
-    if (p00cache[i].cluster == cluster)
+    if (p00cache[i].cluster == cluster) {
+      stats_inc(STAT_P00CACHE_HITS);
       return p00cache[i].name;
+    }
   }
 
   /* noting found */
+  stats_inc(STAT_P00CACHE_MISSES);
   return NULL;
 }
 
@@ -0,0 +1,83 @@
+/* sd2iec - SD/MMC to Commodore serial bus interface/controller
+   Copyright (C) 2007-2022  Ingo Korb <ingo@akana.de>
+
+   Inspired by MMC2IEC by Lars Pontoppidan et al.
+
+   FAT filesystem access based on code from ChaN and Jim Brain, see ff.c|h.
+
+   This program is free software; you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation; version 2 of the License only.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program; if not, write to the Free Software
+   Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+
+
+
+   profile.c: Cycle counters for selected functions
+
+*/
+
+#include <stdint.h>
+#include <string.h>
+#include "config.h"
+#include "timer.h"
+#include "profile.h"
+
+/*
+ * Functions are profiled by calling profile_enter at their start and
+ * profile_exit on the path that should be measured, usually the one
+ * that returns successfully. An exit without a matching entry is
+ * ignored, so early error returns don't need a hook. The counters are
+ * read with XP and use CPU cycles as unit.
+ */
+
+profile_t profile_data[PROF_COUNT];
+
+static uint32_t entry_cycles[PROF_COUNT];
+static uint8_t  active;
+
+/**
+ * profile_enter - mark the start of a profiled function
+ * @id: function number (PROF_*)
+ */
+void profile_enter(uint8_t id) {
+  entry_cycles[id] = cycle_count();
+  active |= 1 << id;
+}
+
+/**
+ * profile_exit - mark the end of a profiled function
+ * @id: function number (PROF_*)
+ *
+ * This function adds the cycles since the last profile_enter call
+ * with the same id to the counters of the function.
+ */
+void profile_exit(uint8_t id) {
+  uint32_t cycles = cycle_count();
+
+  if (!(active & (1 << id)))
+    return;
+
+  active &= (uint8_t)~(1 << id);
+  cycles  = cycle_diff(entry_cycles[id], cycles);
+
+  profile_data[id].calls++;
+  profile_data[id].cycles += cycles;
+  if (cycles > profile_data[id].max)
+    profile_data[id].max = cycles;
+}
+
+/**
+ * profile_reset - clear all profiling counters
+ */
+void profile_reset(void) {
+  memset(profile_data, 0, sizeof(profile_data));
+  active = 0;
+}
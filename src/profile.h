@@ -0,0 +1,63 @@
+/* sd2iec - SD/MMC to Commodore serial bus interface/controller
+   Copyright (C) 2007-2022  Ingo Korb <ingo@akana.de>
+
+   Inspired by MMC2IEC by Lars Pontoppidan et al.
+
+   FAT filesystem access based on code from ChaN and Jim Brain, see ff.c|h.
+
+   This program is free software; you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation; version 2 of the License only.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program; if not, write to the Free Software
+   Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+
+
+
+   profile.h: Cycle counters for selected functions
+
+*/
+
+#ifndef PROFILE_H
+#define PROFILE_H
+
+/* Functions with profiling hooks, the numbers are used by XP */
+enum {
+  PROF_SD_READ = 0,
+  PROF_SD_WRITE,
+  PROF_FAT_WINDOW,
+  PROF_F_READ,
+  PROF_F_WRITE,
+  PROF_DOSCMD,
+  PROF_COUNT
+};
+
+typedef struct {
+  uint32_t calls;
+  uint32_t cycles;
+  uint32_t max;
+} profile_t;
+
+#ifdef CONFIG_PROFILING
+
+extern profile_t profile_data[PROF_COUNT];
+
+void profile_enter(uint8_t id);
+void profile_exit(uint8_t id);
+void profile_reset(void);
+
+#else
+
+#  define profile_enter(x) do {} while (0)
+#  define profile_exit(x)  do {} while (0)
+#  define profile_reset()  do {} while (0)
+
+#endif
+
+#endif
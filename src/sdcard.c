@@ -28,10 +28,15 @@
 
 */
 
+#include <stddef.h>
+#include <string.h>
 #include "config.h"
 #include "crc.h"
 #include "diskio.h"
+#include "eeprom-conf.h"
+#include "profile.h"
 #include "spi.h"
+#include "stats.h"
 #include "timer.h"
 #include "uart.h"
 #include "sdcard.h"
@@ -167,9 +172,18 @@ static uint32_t getbits(void *buffer, uint16_t start, int8_t bits) {
 /*  internal SD functions                                                    */
 /* ------------------------------------------------------------------------- */
 
+#ifdef CONFIG_SD_WRITE_QUEUE
+/* Set when the card of a drive was changed, its queued sectors are dropped */
+static volatile uint8_t wq_changed[MAX_CARDS];
+#  define queue_card_changed(drv) do { wq_changed[drv] = 1; } while (0)
+#else
+#  define queue_card_changed(drv) do {} while (0)
+#endif
+
 /* Detect changes of SD card 0 */
 #ifdef SD_CHANGE_HANDLER
 SD_CHANGE_HANDLER {
+  queue_card_changed(0);
   if (sdcard_detect())
     disk_state = DISK_CHANGED;
   else
@@ -180,6 +194,7 @@ SD_CHANGE_HANDLER {
 #if defined(CONFIG_TWINSD) && defined(SD2_CHANGE_HANDLER)
 /* Detect changes of SD card 1 */
 SD2_CHANGE_HANDLER {
+  queue_card_changed(1);
   if (sdcard2_detect())
     disk_state = DISK_CHANGED;
   else
@@ -286,6 +301,418 @@ static uint8_t send_command(const uint8_t  card,
   return res;
 }
 
+/* ------------------------------------------------------------------------- */
+/*  Adaptive SPI clock                                                       */
+/* ------------------------------------------------------------------------- */
+
+#ifdef CONFIG_SD_AUTOSPEED
+
+#if !defined(SSP_CLK_DIVISOR_HS) || !defined(SSP_CLK_DIVISOR_MIN)
+#  error "CONFIG_SD_AUTOSPEED is not supported on this architecture!"
+#endif
+
+/* number of cards whose clock setting is remembered */
+#define SPEED_CARDS  SDSPEED_ENTRIES
+
+/* error-free blocks before the next faster clock is tried */
+#define SPEED_WINDOW 256
+
+/* CRC errors within one window that make the clock slower */
+#define SPEED_ERRORS 2
+
+typedef struct {
+  uint32_t serial;   /* manufacturer ID and serial number from the CID */
+  uint16_t good;     /* error-free blocks in the current window */
+  uint8_t  errors;   /* CRC errors in the current window */
+  uint8_t  divisor;  /* current SSP clock divisor */
+  uint8_t  floor;    /* smallest divisor that may be tried */
+} sd_speed_t;
+
+static sd_speed_t  speedtab[SPEED_CARDS];
+static sd_speed_t *card_speed[MAX_CARDS];
+static uint8_t     speed_next;
+static uint8_t     speed_dirty;   /* entries to be stored, one bit each */
+static uint8_t     active_divisor;
+
+/* the SPI interface was switched to slow speed */
+#define speed_reset() do { active_divisor = 0; } while (0)
+
+/**
+ * speed_load - read the stored clock settings
+ *
+ * This function fills the table of clock settings from the EEPROM.
+ */
+static void speed_load(void) {
+  sdspeed_t entry;
+  uint8_t   i;
+
+  speed_next = SPEED_CARDS;
+  for (i = 0; i < SPEED_CARDS; i++) {
+    if (read_sdspeed(i, &entry) &&
+        entry.floor   >= SSP_CLK_DIVISOR_MIN &&
+        entry.divisor >= entry.floor &&
+        entry.divisor <= SSP_CLK_DIVISOR_MAX) {
+      speedtab[i].serial  = entry.serial;
+      speedtab[i].divisor = entry.divisor;
+      speedtab[i].floor   = entry.floor;
+    } else if (speed_next == SPEED_CARDS) {
+      speed_next = i;
+    }
+  }
+
+  if (speed_next == SPEED_CARDS)
+    speed_next = 0;
+}
+
+/* store the clock setting of a card when the bus is idle */
+#define speed_save(sp) do { speed_dirty |= 1 << ((sp) - speedtab); } while (0)
+
+/**
+ * sd_speed_save_step - store one changed clock setting
+ *
+ * This function writes the oldest changed entry of the table of clock
+ * settings to the EEPROM, so the card starts with it after the next
+ * power cycle. It is called while the bus is idle because the EEPROM
+ * write takes several milliseconds. Returns 1 if an entry was written,
+ * 0 if there is nothing to do.
+ */
+uint8_t sd_speed_save_step(void) {
+  sdspeed_t entry;
+  uint8_t   i;
+
+  if (speed_dirty == 0)
+    return 0;
+
+  for (i = 0; !(speed_dirty & (1 << i)); i++) ;
+  speed_dirty &= (uint8_t)~(1 << i);
+
+  entry.serial  = speedtab[i].serial;
+  entry.divisor = speedtab[i].divisor;
+  entry.floor   = speedtab[i].floor;
+  write_sdspeed(i, &entry);
+
+  return 1;
+}
+
+/**
+ * speed_apply - set the SPI clock for a card
+ * @drv: drive
+ *
+ * This function switches the SPI interface to the fast clock
+ * divisor of the card in @drv if it is not already active.
+ */
+static void speed_apply(uint8_t drv) {
+  sd_speed_t *sp = card_speed[drv];
+
+  if (sp == NULL || sp->divisor == active_divisor)
+    return;
+
+  spi_set_fast_divisor(sp->divisor);
+  spi_set_speed(SPI_SPEED_FAST);
+  active_divisor = sp->divisor;
+}
+
+/**
+ * speed_good - account an error-free block transfer
+ * @drv: drive
+ *
+ * This function counts a block transferred without CRC errors and
+ * tries the next faster clock when a whole window was error-free.
+ */
+static void speed_good(uint8_t drv) {
+  sd_speed_t *sp = card_speed[drv];
+
+  if (sp == NULL || ++sp->good < SPEED_WINDOW)
+    return;
+
+  sp->good   = 0;
+  sp->errors = 0;
+  if (sp->divisor > sp->floor) {
+    sp->divisor -= 2;
+    speed_apply(drv);
+
+    /* remember the fastest setting once it is reached */
+    if (sp->divisor == sp->floor)
+      speed_save(sp);
+  }
+}
+
+/**
+ * speed_error - account a transfer error
+ * @drv: drive
+ *
+ * This function counts a CRC error or a failed command or data token
+ * of a block transfer. If too many errors happen within one window,
+ * the clock is made slower and the faster setting is not tried again
+ * for this card, which is also stored in the EEPROM.
+ */
+static void speed_error(uint8_t drv) {
+  sd_speed_t *sp = card_speed[drv];
+
+  if (sp == NULL || ++sp->errors < SPEED_ERRORS)
+    return;
+
+  sp->good   = 0;
+  sp->errors = 0;
+  if (sp->divisor < SSP_CLK_DIVISOR_MAX) {
+    sp->divisor += 2;
+    sp->floor    = sp->divisor;
+    speed_apply(drv);
+    speed_save(sp);
+  }
+}
+
+/**
+ * switch_highspeed - switch an SD card to high speed mode
+ * @drv: drive
+ *
+ * This function asks the SD card in @drv to switch to high speed
+ * mode using CMD6. Returns the smallest SSP clock divisor the
+ * card supports afterwards.
+ */
+static uint8_t switch_highspeed(uint8_t drv) {
+  uint8_t  buf[64];
+  uint16_t crc;
+
+  /* select high speed in function group 1, keep all other groups */
+  if (send_command(drv, SWITCH_FUNC, 0x80fffff1) != 0 ||
+      !expect_byte(0xfe)) {
+    /* SD 1.0 cards do not know CMD6 */
+    deselect_card();
+    return SSP_CLK_DIVISOR_DS;
+  }
+
+  spi_rx_block(buf, 64);
+  crc  = spi_rx_byte() << 8;
+  crc |= spi_rx_byte();
+  deselect_card();
+
+  /* bits 379:376 of the status are the selected function of group 1 */
+  if (crc == crc_xmodem_block(0, buf, 64) && (buf[16] & 0x0f) == 1)
+    return SSP_CLK_DIVISOR_HS;
+  else
+    return SSP_CLK_DIVISOR_DS;
+}
+
+/**
+ * speed_init - select the clock setting of a newly initialized card
+ * @drv  : drive
+ * @floor: smallest SSP clock divisor the card supports
+ *
+ * This function identifies the card in @drv by its CID and continues
+ * with the clock setting found for it earlier. Unknown cards replace
+ * the oldest entry of the table and start at SSP_CLK_DIVISOR_FAST.
+ */
+static void speed_init(uint8_t drv, uint8_t floor) {
+  uint8_t     buf[18];
+  uint32_t    serial = 0;
+  sd_speed_t *sp = NULL;
+  uint8_t     i;
+
+  /* read the CID */
+  if (send_command(drv, SEND_CID, 0) == 0 && expect_byte(0xfe)) {
+    spi_rx_block(buf, 18);
+    serial = getbits(buf, 127-55, 32) ^ ((uint32_t)buf[0] << 24);
+  }
+  deselect_card();
+
+  for (i = 0; i < SPEED_CARDS; i++) {
+    if (speedtab[i].divisor != 0 && speedtab[i].serial == serial) {
+      sp = &speedtab[i];
+      break;
+    }
+  }
+
+  if (sp == NULL) {
+    do {
+      sp = &speedtab[speed_next];
+      speed_next = (speed_next + 1) % SPEED_CARDS;
+#ifdef CONFIG_TWINSD
+    } while (sp == card_speed[!drv]);
+#else
+    } while (0);
+#endif
+
+    sp->serial  = serial;
+    sp->divisor = SSP_CLK_DIVISOR_FAST;
+    sp->floor   = floor;
+  }
+
+  /* the SSP can not run at the full high speed clock */
+  if (floor < SSP_CLK_DIVISOR_MIN)
+    floor = SSP_CLK_DIVISOR_MIN;
+
+  if (sp->floor < floor)
+    sp->floor = floor;
+  if (sp->divisor < sp->floor)
+    sp->divisor = sp->floor;
+
+  sp->good   = 0;
+  sp->errors = 0;
+  card_speed[drv] = sp;
+  speed_apply(drv);
+}
+
+#else
+#  define speed_load()     do {} while (0)
+#  define speed_reset()    do {} while (0)
+#  define speed_apply(drv) do {} while (0)
+#  define speed_good(drv)  do {} while (0)
+#  define speed_error(drv) do {} while (0)
+#endif
+
+/* ------------------------------------------------------------------------- */
+/*  Write queue                                                              */
+/* ------------------------------------------------------------------------- */
+
+#ifdef CONFIG_SD_WRITE_QUEUE
+
+/*
+ * sd_write copies the sectors into the queue and returns, they are
+ * written to the card by sd_flush_step while the bus is idle or by
+ * sd_flush. wq_slot is a permutation of all slots, its first wq_count
+ * entries are the queued sectors in the order they were written.
+ */
+static uint32_t wq_data[CONFIG_SD_WRITE_QUEUE][512/4]; // aligned for DMA
+static DWORD    wq_sector[CONFIG_SD_WRITE_QUEUE];
+static uint8_t  wq_drv[CONFIG_SD_WRITE_QUEUE];
+static uint8_t  wq_slot[CONFIG_SD_WRITE_QUEUE];
+static uint8_t  wq_count;
+static DRESULT  wq_result;
+
+static DRESULT write_sectors(BYTE drv, const BYTE *buffer, DWORD sector, BYTE count);
+
+static void queue_init(void) {
+  uint8_t i;
+
+  for (i = 0; i < CONFIG_SD_WRITE_QUEUE; i++)
+    wq_slot[i] = i;
+}
+
+/**
+ * queue_find - find a queued sector
+ * @drv   : drive
+ * @sector: sector number
+ *
+ * This function returns the position of @sector of @drv in wq_slot
+ * or -1 if the sector is not queued.
+ */
+static int8_t queue_find(uint8_t drv, DWORD sector) {
+  uint8_t i;
+
+  for (i = 0; i < wq_count; i++) {
+    uint8_t s = wq_slot[i];
+
+    if (wq_sector[s] == sector && wq_drv[s] == drv)
+      return i;
+  }
+
+  return -1;
+}
+
+/**
+ * queue_remove - remove a sector from the queue
+ * @pos: position in wq_slot
+ *
+ * This function removes the queued sector at position @pos of wq_slot
+ * without writing it.
+ */
+static void queue_remove(uint8_t pos) {
+  uint8_t s = wq_slot[pos];
+
+  memmove(wq_slot + pos, wq_slot + pos + 1, CONFIG_SD_WRITE_QUEUE - 1 - pos);
+  wq_slot[CONFIG_SD_WRITE_QUEUE - 1] = s;
+  wq_count--;
+}
+
+/**
+ * queue_write - write the oldest queued sector to the card
+ *
+ * This function writes the oldest queued sector and removes it from
+ * the queue, even if the write failed. Nothing is written if the card
+ * of the drive was changed since the sector was queued. A failed
+ * write sets disk_state to DISK_ERROR. Returns the result of the
+ * write, the first error is also kept for sd_flush.
+ */
+static DRESULT queue_write(void) {
+  uint8_t s = wq_slot[0];
+  DRESULT res;
+
+  if (wq_changed[wq_drv[s]])
+    res = RES_NOTRDY;
+  else
+    res = write_sectors(wq_drv[s], (BYTE *)wq_data[s], wq_sector[s], 1);
+
+  queue_remove(0);
+  if (res != RES_OK) {
+    if (disk_state == DISK_OK)
+      disk_state = DISK_ERROR;
+    if (wq_result == RES_OK)
+      wq_result = res;
+  }
+
+  return res;
+}
+
+/**
+ * queue_reinit - prepare the queue for the initialisation of a card
+ * @drv: drive
+ *
+ * This function drops the queued sectors of @drv if its card was
+ * changed, otherwise they are written first because the file system
+ * on the card is mounted again without reading them back.
+ */
+static void queue_reinit(uint8_t drv) {
+  uint8_t i = 0;
+
+  if (wq_changed[drv]) {
+    while (i < wq_count) {
+      if (wq_drv[wq_slot[i]] == drv) {
+        queue_remove(i);
+        wq_result = RES_NOTRDY;
+      } else {
+        i++;
+      }
+    }
+    wq_changed[drv] = 0;
+  } else {
+    while (wq_count > 0)
+      queue_write();
+  }
+}
+
+/**
+ * queue_read - read a sector from the queue
+ * @drv   : drive
+ * @sector: sector number
+ * @buffer: target buffer
+ *
+ * This function copies @sector of @drv to @buffer if it is queued,
+ * the card still has the old contents in that case. Returns 1 if
+ * the sector was copied, 0 if it must be read from the card.
+ */
+static uint8_t queue_read(uint8_t drv, DWORD sector, BYTE *buffer) {
+  int8_t pos = queue_find(drv, sector);
+
+  if (pos < 0)
+    return 0;
+
+  memcpy(buffer, wq_data[wq_slot[pos]], 512);
+  return 1;
+}
+
+#else
+#  define queue_init()        do {} while (0)
+#  define queue_reinit(drv)   do {} while (0)
+
+static inline uint8_t queue_read(uint8_t drv, DWORD sector, BYTE *buffer) {
+  (void)drv;
+  (void)sector;
+  (void)buffer;
+  return 0;
+}
+#endif
+
 /* ------------------------------------------------------------------------- */
 /*  external SD functions                                                    */
 /* ------------------------------------------------------------------------- */
@@ -297,6 +724,8 @@ static uint8_t send_command(const uint8_t  card,
  */
 void sd_init(void) {
   sdcard_interface_init();
+  queue_init();
+  speed_load();
 }
 void disk_init(void) __attribute__ ((weak, alias("sd_init")));
 
@@ -348,10 +777,16 @@ DSTATUS sd_initialize(BYTE drv) {
   uint16_t tries = 3;
   uint8_t  i,res;
   tick_t   timeout;
+#ifdef CONFIG_SD_AUTOSPEED
+  uint8_t  sdcard = 0;
+#endif
 
   if (drv >= MAX_CARDS)
     return STA_NOINIT | STA_NODISK;
 
+  /* write or drop the sectors queued for the card */
+  queue_reinit(drv);
+
   /* skip initialisation if the card is not present */
   if (sd_status(drv) & STA_NODISK)
     return sd_status(drv);
@@ -365,6 +800,7 @@ DSTATUS sd_initialize(BYTE drv) {
 #else
   spi_set_speed(SPI_SPEED_SLOW);
 #endif
+  speed_reset();
 
  retry:
   disk_state = DISK_ERROR;
@@ -444,6 +880,10 @@ DSTATUS sd_initialize(BYTE drv) {
   if (res != 0)
     goto not_sd;
 
+#ifdef CONFIG_SD_AUTOSPEED
+  sdcard = 1;
+#endif
+
   /* send READ_OCR to detect SDHC cards */
   res = send_command(drv, READ_OCR, 0);
 
@@ -481,7 +921,12 @@ DSTATUS sd_initialize(BYTE drv) {
   if (res != 0)
     return STA_NOINIT;
 
+#ifdef CONFIG_SD_AUTOSPEED
+  /* MMC cards stay at the default fast clock */
+  speed_init(drv, sdcard ? switch_highspeed(drv) : SSP_CLK_DIVISOR_FAST);
+#else
   spi_set_speed(SPI_SPEED_FAST);
+#endif
   disk_state = DISK_OK;
 
   return sd_status(drv);
@@ -502,19 +947,29 @@ DSTATUS disk_initialize(BYTE drv) __attribute__ ((weak, alias("sd_initialize")))
  * the calculated data CRC does not match the one sent by the
  * card. If there were errors during the command transmission
  * disk_state will be set to DISK_ERROR and no retries are made.
+ * Sectors that are still in the write queue are copied from there.
  */
 DRESULT sd_read(BYTE drv, BYTE *buffer, DWORD sector, BYTE count) {
   uint8_t  res, sec, errors;
   uint16_t crc, recvcrc;
+  DWORD    first = sector;
 
   if (drv >= MAX_CARDS)
     return RES_PARERR;
 
+  profile_enter(PROF_SD_READ);
+  speed_apply(drv);
+
   /* convert sector number to byte offset for non-SDHC cards */
   if (cardtype[drv] == CARD_MMCSD)
     sector <<= 9;
 
   for (sec = 0; sec < count; sec++) {
+    if (queue_read(drv, first + sec, buffer)) {
+      buffer += 512;
+      continue;
+    }
+
     errors = 0;
     while (errors < CONFIG_SD_AUTO_RETRIES) {
       /* send read command */
@@ -526,6 +981,7 @@ DRESULT sd_read(BYTE drv, BYTE *buffer, DWORD sector, BYTE count) {
       /* fail if the command wasn't accepted */
       if (res != 0) {
         deselect_card();
+        speed_error(drv);
         disk_state = DISK_ERROR;
         return RES_ERROR;
       }
@@ -533,6 +989,7 @@ DRESULT sd_read(BYTE drv, BYTE *buffer, DWORD sector, BYTE count) {
       /* wait for start block token */
       if (!expect_byte(0xfe)) {
         deselect_card();
+        speed_error(drv);
         disk_state = DISK_ERROR;
         return RES_ERROR;
       }
@@ -540,11 +997,25 @@ DRESULT sd_read(BYTE drv, BYTE *buffer, DWORD sector, BYTE count) {
       /* transfer data */
       crc = 0;
 #ifdef CONFIG_SD_BLOCKTRANSFER
+#  ifdef HAVE_SPI_BACKGROUND
+      /* calculate CRC over the received part while DMA fetches the rest */
+      unsigned int done = 0, avail;
+
+      crc = 0;
+      spi_rx_start(buffer, 512);
+      do {
+        avail = spi_rx_done();
+        crc   = crc_xmodem_block(crc, buffer + done, avail - done);
+        done  = avail;
+      } while (done < 512);
+#  else
       /* transfer data first, calculate CRC afterwards */
       spi_rx_block(buffer, 512);
-
-      recvcrc = spi_rx_byte() << 8 | spi_rx_byte();
       crc = crc_xmodem_block(0, buffer, 512);
+#  endif
+
+      recvcrc  = spi_rx_byte() << 8;
+      recvcrc |= spi_rx_byte();
 #else
       /* interleave transfer/CRC calculation, AVR-optimized */
       uint16_t i;
@@ -575,6 +1046,9 @@ DRESULT sd_read(BYTE drv, BYTE *buffer, DWORD sector, BYTE count) {
       if (recvcrc != crc) {
         uart_putc('X');
         deselect_card();
+        stats_inc(STAT_SD_RETRIES);
+        stats_inc(STAT_SD_CRC_ERRORS);
+        speed_error(drv);
         errors++;
         continue;
       }
@@ -586,16 +1060,19 @@ DRESULT sd_read(BYTE drv, BYTE *buffer, DWORD sector, BYTE count) {
     if (errors >= CONFIG_SD_AUTO_RETRIES)
       return RES_ERROR;
 
+    stats_inc(STAT_SD_READS);
+    speed_good(drv);
     buffer += 512;
   }
 
+  profile_exit(PROF_SD_READ);
   return RES_OK;
 }
 DRESULT disk_read(BYTE drv, BYTE *buffer, DWORD sector, BYTE count) __attribute__ ((weak, alias("sd_read")));
 
 
 /**
- * sd_write - writes sectors from buffer to the SD card
+ * write_sectors - writes sectors from buffer to the SD card
  * @drv   : drive
  * @buffer: pointer to the buffer
  * @sector: first sector to be written
@@ -609,7 +1086,7 @@ DRESULT disk_read(BYTE drv, BYTE *buffer, DWORD sector, BYTE count) __attribute_
  * transmission disk_state will be set to DISK_ERROR and no retries
  * are made.
  */
-DRESULT sd_write(BYTE drv, const BYTE *buffer, DWORD sector, BYTE count) {
+static DRESULT write_sectors(BYTE drv, const BYTE *buffer, DWORD sector, BYTE count) {
   uint8_t  res, sec, errors;
   uint16_t crc;
 
@@ -620,6 +1097,9 @@ DRESULT sd_write(BYTE drv, const BYTE *buffer, DWORD sector, BYTE count) {
   if (sd_wrprot(drv))
     return RES_WRPRT;
 
+  profile_enter(PROF_SD_WRITE);
+  speed_apply(drv);
+
   /* convert sector number to byte offset for non-SDHC cards */
   if (cardtype[drv] == CARD_MMCSD)
     sector <<= 9;
@@ -636,6 +1116,7 @@ DRESULT sd_write(BYTE drv, const BYTE *buffer, DWORD sector, BYTE count) {
       /* fail if the command wasn't accepted */
       if (res != 0) {
         deselect_card();
+        speed_error(drv);
         disk_state = DISK_ERROR;
         return RES_ERROR;
       }
@@ -645,8 +1126,15 @@ DRESULT sd_write(BYTE drv, const BYTE *buffer, DWORD sector, BYTE count) {
 
       /* transfer data */
 #ifdef CONFIG_SD_BLOCKTRANSFER
+#  ifdef HAVE_SPI_BACKGROUND
+      /* calculate CRC while DMA transmits the data */
+      spi_tx_start(buffer, 512);
+      crc = crc_xmodem_block(0, buffer, 512);
+      spi_tx_wait();
+#  else
       spi_tx_block(buffer, 512);
       crc = crc_xmodem_block(0, buffer, 512);
+#  endif
 #else
       /* interleave transfer/CRC calculations, AVR-optimized */
       uint16_t i;
@@ -672,6 +1160,11 @@ DRESULT sd_write(BYTE drv, const BYTE *buffer, DWORD sector, BYTE count) {
       if ((res & 0x0f) != 0x05) {
         uart_putc('X');
         deselect_card();
+        stats_inc(STAT_SD_RETRIES);
+        if ((res & 0x0f) == 0x0b) {
+          stats_inc(STAT_SD_CRC_ERRORS);
+          speed_error(drv);
+        }
         errors++;
         continue;
       }
@@ -690,11 +1183,127 @@ DRESULT sd_write(BYTE drv, const BYTE *buffer, DWORD sector, BYTE count) {
       return RES_ERROR;
     }
 
+    stats_inc(STAT_SD_WRITES);
+    speed_good(drv);
     buffer += 512;
   }
 
+  profile_exit(PROF_SD_WRITE);
   return RES_OK;
 }
+
+#ifdef CONFIG_SD_WRITE_QUEUE
+
+/**
+ * sd_write - queues sectors from buffer for the SD card
+ * @drv   : drive
+ * @buffer: pointer to the buffer
+ * @sector: first sector to be written
+ * @count : number of sectors to be written
+ *
+ * This function copies count sectors from buffer into the write
+ * queue, replacing older queued versions of the same sectors. The
+ * oldest queued sector is written first if the queue is full.
+ * Writes of at least CONFIG_SD_WRITE_QUEUE sectors bypass the queue.
+ * Returns RES_WRPRT if the card is currently write-protected, the
+ * result of the card write if one was needed or RES_OK otherwise.
+ */
+DRESULT sd_write(BYTE drv, const BYTE *buffer, DWORD sector, BYTE count) {
+  int8_t  pos;
+  uint8_t s;
+  DRESULT res;
+
+  if (drv >= MAX_CARDS)
+    return RES_PARERR;
+
+  if (sd_wrprot(drv))
+    return RES_WRPRT;
+
+  if (count >= CONFIG_SD_WRITE_QUEUE) {
+    /* drop older versions and write directly */
+    for (s = 0; s < count; s++) {
+      pos = queue_find(drv, sector + s);
+      if (pos >= 0)
+        queue_remove(pos);
+    }
+    return write_sectors(drv, buffer, sector, count);
+  }
+
+  while (count--) {
+    pos = queue_find(drv, sector);
+    if (pos >= 0) {
+      s = wq_slot[pos];
+    } else {
+      if (wq_count == CONFIG_SD_WRITE_QUEUE) {
+        res = queue_write();
+        if (res != RES_OK)
+          return res;
+      }
+
+      s = wq_slot[wq_count++];
+      wq_drv[s]    = drv;
+      wq_sector[s] = sector;
+    }
+
+    memcpy(wq_data[s], buffer, 512);
+    buffer += 512;
+    sector++;
+  }
+
+  return RES_OK;
+}
+
+/**
+ * sd_flush_step - write one queued sector
+ *
+ * This function writes the oldest sector of the write queue to the
+ * card. It is called while the bus is idle. Returns 1 if a sector
+ * was written, 0 if the queue is empty.
+ */
+uint8_t sd_flush_step(void) {
+  if (wq_count == 0)
+    return 0;
+
+  queue_write();
+  return 1;
+}
+uint8_t disk_flush_step(void) __attribute__ ((weak, alias("sd_flush_step")));
+
+/**
+ * sd_flush - write all queued sectors
+ *
+ * This function writes all sectors of the write queue to the card.
+ * Returns the result of the first write that failed since the last
+ * call, including writes done by sd_flush_step, or RES_OK.
+ */
+DRESULT sd_flush(void) {
+  DRESULT res;
+
+  while (wq_count > 0)
+    queue_write();
+
+  res = wq_result;
+  wq_result = RES_OK;
+  return res;
+}
+DRESULT disk_flush(void) __attribute__ ((weak, alias("sd_flush")));
+
+#else
+
+/**
+ * sd_write - writes sectors from buffer to the SD card
+ * @drv   : drive
+ * @buffer: pointer to the buffer
+ * @sector: first sector to be written
+ * @count : number of sectors to be written
+ *
+ * This function writes count sectors directly, see write_sectors.
+ */
+DRESULT sd_write(BYTE drv, const BYTE *buffer, DWORD sector, BYTE count) {
+  return write_sectors(drv, buffer, sector, count);
+}
+
+#endif
 DRESULT disk_write(BYTE drv, const BYTE *buffer, DWORD sector, BYTE count) __attribute__ ((weak, alias("sd_write")));
 
 
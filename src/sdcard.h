@@ -35,5 +35,13 @@ DSTATUS sd_initialize(BYTE drv);
 DRESULT sd_read(BYTE drv, BYTE *buffer, DWORD sector, BYTE count);
 DRESULT sd_write(BYTE drv, const BYTE *buffer, DWORD sector, BYTE count);
 DRESULT sd_getinfo(BYTE drv, BYTE page, void *buffer);
+DRESULT sd_flush(void);
+uint8_t sd_flush_step(void);
+
+#ifdef CONFIG_SD_AUTOSPEED
+uint8_t sd_speed_save_step(void);
+#else
+static inline uint8_t sd_speed_save_step(void) { return 0; }
+#endif
 
 #endif
@@ -0,0 +1,69 @@
+/* sd2iec - SD/MMC to Commodore serial bus interface/controller
+   Copyright (C) 2007-2022  Ingo Korb <ingo@akana.de>
+
+   Inspired by MMC2IEC by Lars Pontoppidan et al.
+
+   FAT filesystem access based on code from ChaN and Jim Brain, see ff.c|h.
+
+   This program is free software; you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation; version 2 of the License only.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program; if not, write to the Free Software
+   Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+
+
+
+   stats.h: Runtime statistics counters
+
+*/
+
+#ifndef STATS_H
+#define STATS_H
+
+/* Counters, XN returns them in groups of four */
+enum {
+  /* XN0 */
+  STAT_SD_READS = 0,
+  STAT_SD_WRITES,
+  STAT_SD_RETRIES,
+  STAT_SD_CRC_ERRORS,
+  /* XN1 */
+  STAT_FAT_WINDOW_LOADS,
+  STAT_P00CACHE_HITS,
+  STAT_P00CACHE_MISSES,
+  STAT_BAM_SWAPS,
+  /* XN2 */
+  STAT_BYTES_STD,       // also used for IEEE-488
+  STAT_BYTES_JIFFY,
+  STAT_BYTES_DOLPHIN,
+  STAT_LOADERS,
+  STAT_COUNT
+};
+
+#define STAT_PAGES (STAT_COUNT / 4)
+
+#ifdef CONFIG_STATISTICS
+
+extern uint32_t stats[STAT_COUNT];
+
+#  define stats_inc(x)   do { stats[x]++; } while (0)
+#  define stats_add(x,n) do { stats[x] += (n); } while (0)
+
+void stats_reset(void);
+
+#else
+
+#  define stats_inc(x)   do {} while (0)
+#  define stats_add(x,n) do { (void)(n); } while (0)
+#  define stats_reset()  do {} while (0)
+
+#endif
+
+#endif
@@ -40,6 +40,25 @@ uint8_t *appendnumber(uint8_t *msg, uint8_t value) {
   return msg;
 }
 
+/* Convert byte to two-character hex string */
+uint8_t *byte_to_hex(uint8_t num, uint8_t *str) {
+  uint8_t tmp;
+
+  tmp = (num & 0xf0) >> 4;
+  if (tmp < 10)
+    *str++ = '0' + tmp;
+  else
+    *str++ = 'a' + tmp - 10;
+
+  tmp = num & 0x0f;
+  if (tmp < 10)
+    *str++ = '0' + tmp;
+  else
+    *str++ = 'a' + tmp - 10;
+
+  return str;
+}
+
 /* Convert a one-byte BCD value to a normal integer */
 uint8_t bcd2int(uint8_t value) {
   return (value & 0x0f) + 10*(value >> 4);
@@ -41,6 +41,9 @@
 /* Write a number to a string as ASCII */
 uint8_t *appendnumber(uint8_t *msg, uint8_t value);
 
+/* Write a byte to a string as two hex digits */
+uint8_t *byte_to_hex(uint8_t num, uint8_t *str);
+
 /* Convert between integer and BCD */
 uint8_t bcd2int(uint8_t value);
 uint8_t int2bcd(uint8_t value);
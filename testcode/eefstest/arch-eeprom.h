@@ -0,0 +1,44 @@
+/* eefstest - host test for the EEPROM file system
+   Copyright (C) 2007-2022  Ingo Korb <ingo@akana.de>
+
+   This program is free software; you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation; version 2 of the License only.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program; if not, write to the Free Software
+   Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+
+
+   arch-eeprom.h: EEPROM emulated in RAM
+
+*/
+
+#ifndef ARCH_EEPROM_H
+#define ARCH_EEPROM_H
+
+#include <stdint.h>
+#include <string.h>
+
+#define EEPROM_SIZE 4096
+
+extern uint8_t  eeprom[EEPROM_SIZE];
+extern unsigned eeprom_reads;  // bytes read from the EEPROM
+extern unsigned eeprom_writes; // bytes written to the EEPROM
+
+static inline void eeprom_read_block(void *destptr, const void *addr, unsigned int length) {
+  eeprom_reads += length;
+  memcpy(destptr, eeprom + (uintptr_t)addr, length);
+}
+
+static inline void eeprom_write_block(const void *srcptr, void *addr, unsigned int length) {
+  eeprom_writes += length;
+  memcpy(eeprom + (uintptr_t)addr, srcptr, length);
+}
+
+#endif
@@ -0,0 +1,29 @@
+/* eefstest - host test for the EEPROM file system
+   Copyright (C) 2007-2022  Ingo Korb <ingo@akana.de>
+
+   This program is free software; you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation; version 2 of the License only.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program; if not, write to the Free Software
+   Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+
+
+   buffers.h: Replacement for the buffer handling of the firmware
+
+*/
+
+#ifndef BUFFERS_H
+#define BUFFERS_H
+
+#include <stdint.h>
+
+extern uint8_t ops_scratch[33];
+
+#endif
@@ -0,0 +1,33 @@
+/* eefstest - host test for the EEPROM file system
+   Copyright (C) 2007-2022  Ingo Korb <ingo@akana.de>
+
+   This program is free software; you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation; version 2 of the License only.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program; if not, write to the Free Software
+   Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+
+
+   config.h: Replacement for the firmware configuration, uses the
+             EEPROM file system layout of the AVR targets
+
+*/
+
+#ifndef CONFIG_H
+#define CONFIG_H
+
+#include <stdint.h>
+
+#define EEPROMFS_OFFSET     512
+#define EEPROMFS_SIZE       3584
+#define EEPROMFS_ENTRIES    8
+#define EEPROMFS_SECTORSIZE 64
+
+#endif
@@ -0,0 +1,304 @@
+/* eefstest - host test for the EEPROM file system
+   Copyright (C) 2007-2022  Ingo Korb <ingo@akana.de>
+
+   This program is free software; you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation; version 2 of the License only.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program; if not, write to the Free Software
+   Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+
+
+   eefstest.c: Runs eeprom-fs.c against an EEPROM emulated in RAM
+
+*/
+
+#include <stdio.h>
+#include <string.h>
+#include "config.h"
+#include "arch-eeprom.h"
+#include "buffers.h"
+#include "eeprom-fs.h"
+
+/* size of a directory entry in the EEPROM */
+#define ENTRY_SIZE 32
+
+/* larger than one name entry can hold, needs list entries */
+#define BIGFILE_SIZE 1500
+
+/* data sectors listed in a name entry */
+#define NAME_SECTORS 12
+
+/* bytes written by each of two files written at the same time */
+#define CHUNK_SIZE  40
+#define CHUNK_COUNT 6
+
+uint8_t  eeprom[EEPROM_SIZE];
+unsigned eeprom_reads;
+unsigned eeprom_writes;
+uint8_t  ops_scratch[33];
+
+static uint8_t  testdata[BIGFILE_SIZE];
+static uint8_t  readbuf[BIGFILE_SIZE + 1];
+static unsigned failures;
+
+/* report the result of a single check */
+static void check(int ok, const char *what) {
+  if (!ok) {
+    printf("FAIL: %s\n", what);
+    failures++;
+  }
+}
+
+/* convert a string to a zero-padded file name */
+static uint8_t *fname(const char *str) {
+  static uint8_t names[2][EEFS_NAME_LENGTH];
+  static uint8_t next;
+  uint8_t *name = names[next];
+
+  next = !next;
+  memset(name, 0, EEFS_NAME_LENGTH);
+  strncpy((char *)name, str, EEFS_NAME_LENGTH);
+  return name;
+}
+
+/* create a file with the first length bytes of testdata */
+static eefs_error_t create_file(const char *name, uint16_t length) {
+  eefs_fh_t    fh;
+  eefs_error_t res;
+  uint16_t     written;
+
+  res = eepromfs_open(fname(name), &fh, EEFS_MODE_WRITE);
+  if (res != EEFS_ERROR_OK)
+    return res;
+
+  res = eepromfs_write(&fh, testdata, length, &written);
+  eepromfs_close(&fh);
+  if (res == EEFS_ERROR_OK && written != length)
+    res = EEFS_ERROR_DISKFULL;
+
+  return res;
+}
+
+/* append length bytes of testdata, starting at offset, to a file */
+static eefs_error_t append_file(const char *name, uint16_t offset, uint16_t length) {
+  eefs_fh_t    fh;
+  eefs_error_t res;
+  uint16_t     written;
+
+  res = eepromfs_open(fname(name), &fh, EEFS_MODE_APPEND);
+  if (res != EEFS_ERROR_OK)
+    return res;
+
+  res = eepromfs_write(&fh, testdata + offset, length, &written);
+  eepromfs_close(&fh);
+  if (res == EEFS_ERROR_OK && written != length)
+    res = EEFS_ERROR_DISKFULL;
+
+  return res;
+}
+
+/* check that a file holds length bytes of testdata, starting at offset */
+static int file_holds(const char *name, uint16_t offset, uint16_t length) {
+  eefs_fh_t fh;
+  uint16_t  bytes;
+
+  if (eepromfs_open(fname(name), &fh, EEFS_MODE_READ) != EEFS_ERROR_OK)
+    return 0;
+
+  eepromfs_read(&fh, readbuf, sizeof(readbuf), &bytes);
+  eepromfs_close(&fh);
+
+  return bytes == length && !memcmp(readbuf, testdata + offset, length);
+}
+
+/* check that a file holds the first length bytes of testdata */
+static int file_matches(const char *name, uint16_t length) {
+  return file_holds(name, 0, length);
+}
+
+/* check if a file can be opened for reading */
+static int file_exists(const char *name) {
+  eefs_fh_t fh;
+
+  return eepromfs_open(fname(name), &fh, EEFS_MODE_READ) == EEFS_ERROR_OK;
+}
+
+/* count the directory entries, check that name is listed if not NULL */
+static unsigned count_files(const char *name, int *found) {
+  eefs_dir_t    dh;
+  eefs_dirent_t dent;
+  unsigned      count = 0;
+
+  if (found)
+    *found = 0;
+
+  eepromfs_opendir(&dh);
+  while (!eepromfs_readdir(&dh, &dent)) {
+    count++;
+    if (name && found && !memcmp(dent.name, fname(name), EEFS_NAME_LENGTH))
+      *found = 1;
+  }
+
+  return count;
+}
+
+int main(void) {
+  static const uint16_t appends[] = {
+    /* sector end, name entry full, new list entry, within it */
+    92, 576, 1, 300, 331
+  };
+  unsigned  i, reads, writes, size;
+  uint8_t   free_empty, free_used;
+  int       found;
+  char      name[8];
+  eefs_fh_t fh1, fh2;
+  uint16_t  written;
+
+  for (i = 0; i < sizeof(testdata); i++)
+    testdata[i] = i * 7 + (i >> 8);
+
+  /* an erased EEPROM */
+  memset(eeprom, 0xff, sizeof(eeprom));
+  eepromfs_init();
+  free_empty = eepromfs_free_sectors();
+  check(count_files(NULL, NULL) == 0, "empty directory");
+
+  /* create: FILEAG and FILEBA have the same name digest */
+  check(create_file("FILEAG", 100) == EEFS_ERROR_OK, "create FILEAG");
+  check(create_file("FILEBA", 200) == EEFS_ERROR_OK, "create FILEBA");
+  check(create_file("BIGFILE", BIGFILE_SIZE) == EEFS_ERROR_OK, "create BIGFILE");
+  check(create_file("FILEAG", 10) == EEFS_ERROR_FILEEXISTS, "create existing file");
+  check(file_matches("FILEAG", 100), "read FILEAG");
+  check(file_matches("FILEBA", 200), "read FILEBA");
+  check(file_matches("BIGFILE", BIGFILE_SIZE), "read BIGFILE");
+  check(count_files(NULL, NULL) == 3, "list after create");
+
+  /* rename */
+  check(eepromfs_rename(fname("FILEAG"), fname("BIGFILE")) == EEFS_ERROR_FILEEXISTS,
+        "rename to existing name");
+  check(eepromfs_rename(fname("NOFILE"), fname("OTHER")) == EEFS_ERROR_FILENOTFOUND,
+        "rename missing file");
+  check(eepromfs_rename(fname("FILEAG"), fname("RENAMED")) == EEFS_ERROR_OK,
+        "rename FILEAG");
+  check(!file_exists("FILEAG"), "old name gone after rename");
+  check(file_matches("RENAMED", 100), "read renamed file");
+  check(file_matches("FILEBA", 200), "read FILEBA after rename");
+
+  /* delete */
+  check(eepromfs_delete(fname("FILEBA")) == EEFS_ERROR_OK, "delete FILEBA");
+  check(eepromfs_delete(fname("FILEBA")) == EEFS_ERROR_FILENOTFOUND, "delete twice");
+  check(!file_exists("FILEBA"), "deleted file gone");
+  check(count_files("RENAMED", &found) == 2 && found, "list after delete");
+  free_used = eepromfs_free_sectors();
+
+  /* restart: the RAM tables are rebuilt from the EEPROM */
+  eepromfs_init();
+  check(eepromfs_free_sectors() == free_used, "free sectors after init");
+  check(count_files("BIGFILE", &found) == 2 && found, "list after init");
+
+  /* digest lookup: a missing name with an unused digest reads nothing */
+  reads = eeprom_reads;
+  check(!file_exists("MISSING"), "open missing file");
+  check(eeprom_reads == reads, "no EEPROM reads for a missing file");
+
+  /* an existing name with a unique digest reads just its entry */
+  reads = eeprom_reads;
+  check(eepromfs_rename(fname("RENAMED"), fname("FILEBA")) == EEFS_ERROR_OK,
+        "rename after init");
+  check(eeprom_reads - reads <= 2 * ENTRY_SIZE, "rename reads only matching entries");
+  check(!file_exists("RENAMED") && file_matches("FILEBA", 100), "read after rename");
+  check(file_matches("BIGFILE", BIGFILE_SIZE), "read BIGFILE after init");
+
+  /* entries of deleted files are reused */
+  check(eepromfs_delete(fname("BIGFILE")) == EEFS_ERROR_OK, "delete BIGFILE");
+  for (i = 0; i < EEPROMFS_ENTRIES; i++) {
+    sprintf(name, "EXTRA%u", i);
+    if (create_file(name, 10) != EEFS_ERROR_OK)
+      break;
+  }
+  check(i == EEPROMFS_ENTRIES - 1, "all free entries usable");
+  check(create_file("FULL", 10) == EEFS_ERROR_DIRFULL, "directory full");
+
+  /* delete everything, before and after another restart */
+  check(eepromfs_delete(fname("FILEBA")) == EEFS_ERROR_OK, "delete FILEBA again");
+  eepromfs_init();
+  check(count_files("EXTRA3", &found) == EEPROMFS_ENTRIES - 1 && found,
+        "list extra files after init");
+  for (i = 0; i < EEPROMFS_ENTRIES - 1; i++) {
+    sprintf(name, "EXTRA%u", i);
+    check(eepromfs_delete(fname(name)) == EEFS_ERROR_OK, "delete extra file");
+  }
+  check(count_files(NULL, NULL) == 0, "empty directory after delete");
+  check(eepromfs_free_sectors() == free_empty, "all sectors free after delete");
+  eepromfs_init();
+  check(eepromfs_free_sectors() == free_empty, "all sectors free after init");
+
+  /* append: grow a file in steps past its name entry */
+  size = 100;
+  check(create_file("APPEND", size) == EEFS_ERROR_OK, "create APPEND");
+  for (i = 0; i < sizeof(appends) / sizeof(appends[0]); i++) {
+    check(append_file("APPEND", size, appends[i]) == EEFS_ERROR_OK, "append to APPEND");
+    size += appends[i];
+    check(file_matches("APPEND", size), "read APPEND after append");
+  }
+  check(size > NAME_SECTORS * EEPROMFS_SECTORSIZE, "APPEND needs a list entry");
+  check(create_file("EMPTY", 0) == EEFS_ERROR_OK, "create EMPTY");
+  check(append_file("EMPTY", 0, 70) == EEFS_ERROR_OK, "append to EMPTY");
+  check(file_matches("EMPTY", 70), "read EMPTY after append");
+  eepromfs_init();
+  check(file_matches("APPEND", size), "read APPEND after init");
+  check(file_matches("EMPTY", 70), "read EMPTY after init");
+  check(eepromfs_delete(fname("APPEND")) == EEFS_ERROR_OK, "delete APPEND");
+  check(eepromfs_delete(fname("EMPTY")) == EEFS_ERROR_OK, "delete EMPTY");
+  check(eepromfs_free_sectors() == free_empty, "all sectors free after append");
+
+  /* two files written at the same time share the write cache */
+  check(eepromfs_open(fname("WRITER1"), &fh1, EEFS_MODE_WRITE) == EEFS_ERROR_OK,
+        "open WRITER1");
+  check(eepromfs_open(fname("WRITER2"), &fh2, EEFS_MODE_WRITE) == EEFS_ERROR_OK,
+        "open WRITER2");
+  for (i = 0; i < CHUNK_COUNT; i++) {
+    eepromfs_write(&fh1, testdata + i * CHUNK_SIZE, CHUNK_SIZE, &written);
+    check(written == CHUNK_SIZE, "write WRITER1");
+    eepromfs_write(&fh2, testdata + 700 + i * CHUNK_SIZE, CHUNK_SIZE, &written);
+    check(written == CHUNK_SIZE, "write WRITER2");
+  }
+  eepromfs_close(&fh1);
+  eepromfs_close(&fh2);
+  check(CHUNK_SIZE * CHUNK_COUNT > 3 * EEPROMFS_SECTORSIZE, "writers cross sectors");
+  check(file_holds("WRITER1", 0, CHUNK_SIZE * CHUNK_COUNT), "read WRITER1");
+  check(file_holds("WRITER2", 700, CHUNK_SIZE * CHUNK_COUNT), "read WRITER2");
+  eepromfs_init();
+  check(file_holds("WRITER1", 0, CHUNK_SIZE * CHUNK_COUNT), "read WRITER1 after init");
+  check(file_holds("WRITER2", 700, CHUNK_SIZE * CHUNK_COUNT), "read WRITER2 after init");
+  check(eepromfs_delete(fname("WRITER1")) == EEFS_ERROR_OK, "delete WRITER1");
+  check(eepromfs_delete(fname("WRITER2")) == EEFS_ERROR_OK, "delete WRITER2");
+
+  /* saving the same file again after a restart only rewrites its entries */
+  memset(eeprom, 0xff, sizeof(eeprom));
+  eepromfs_init();
+  writes = eeprom_writes;
+  check(create_file("BIGFILE", BIGFILE_SIZE) == EEFS_ERROR_OK, "create BIGFILE again");
+  check(eeprom_writes - writes >= BIGFILE_SIZE, "first save writes the data");
+  check(eepromfs_delete(fname("BIGFILE")) == EEFS_ERROR_OK, "delete BIGFILE again");
+  eepromfs_init();
+  writes = eeprom_writes;
+  check(create_file("BIGFILE", BIGFILE_SIZE) == EEFS_ERROR_OK, "save BIGFILE unchanged");
+  check(eeprom_writes - writes <= 2 * ENTRY_SIZE, "unchanged data is not written");
+  check(file_matches("BIGFILE", BIGFILE_SIZE), "read unchanged BIGFILE");
+
+  if (failures) {
+    printf("%u checks failed\n", failures);
+    return 1;
+  }
+
+  printf("all checks passed\n");
+  return 0;
+}
@@ -0,0 +1,279 @@
+/* ieeetest - host test for the IEEE-488 talk handshake
+   Copyright (C) 2007-2022  Ingo Korb <ingo@akana.de>
+
+   This program is free software; you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation; version 2 of the License only.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program; if not, write to the Free Software
+   Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+
+
+   ieeetest.c: Runs ieee_putblock from ieee.c against a simulated listener
+
+*/
+
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+
+/* definitions from ieee.c, timer.h and stats.h */
+#define IEEE_TIMEOUT_MS 64
+#define ATN_POLLED      (uint8_t)-3      // 0xfd
+#define TIMEOUT_ABORT   (uint8_t)-4      // 0xfc
+
+typedef uint32_t tick_t;
+#define MS_TO_TICKS(x)   (x)
+#define time_after(a,b)  ((int32_t)((b) - (a)) < 0)
+
+#define STAT_BYTES_STD 0
+#define stats_add(x,n) do { stat_bytes += (n); } while (0)
+
+/* the part of buffer_t used by ieee_putblock */
+typedef struct {
+  uint8_t *data;
+  uint8_t  lastused;
+  uint8_t  position;
+  uint8_t  sendeoi;
+} buffer_t;
+
+/* delay until the simulated listener never answers */
+#define STALL 0xffffffffU
+
+/* listener state, the line variables are 1 for high (inactive) */
+enum { L_BUSY, L_READY, L_LATCHED, L_ACCEPTED };
+
+static struct {
+  uint8_t  atn, dav, eoi, nrfd, ndac, data;
+  uint8_t  state;
+  tick_t   now, next;
+  uint32_t delay;       // ticks the listener needs for each step
+  unsigned stall_byte;  // byte the listener does not accept
+  unsigned atn_byte;    // byte that is answered with ATN when put on the bus
+  unsigned atn_settle;  // byte that is answered with ATN while settling
+  unsigned put;         // bytes put on the bus
+  unsigned settled;     // calls of _delay_us
+  tick_t   atn_time;    // time ATN was set
+  unsigned received;    // bytes accepted by the listener
+  unsigned ports_talk;
+} sim;
+
+static uint8_t  rxdata[256];
+static uint8_t  rxeoi[256];
+static uint8_t  position;
+static unsigned stat_bytes;
+static tick_t   timeout;
+static unsigned failures;
+
+/* advance the listener if its next step is due */
+static void sim_update(void) {
+  uint32_t delay = sim.delay;
+
+  if (sim.received == sim.stall_byte && sim.state == L_LATCHED)
+    delay = STALL;
+
+  switch (sim.state) {
+  case L_BUSY:
+    if (sim.now >= sim.next) {
+      sim.nrfd  = 1;
+      sim.state = L_READY;
+    }
+    break;
+
+  case L_READY:
+    if (!sim.dav) {
+      sim.nrfd  = 0;
+      rxdata[sim.received] = sim.data;
+      rxeoi[sim.received]  = !sim.eoi;
+      sim.state = L_LATCHED;
+      sim.next  = sim.now + delay;
+    }
+    break;
+
+  case L_LATCHED:
+    if (delay != STALL && sim.now >= sim.next) {
+      sim.ndac  = 1;
+      sim.state = L_ACCEPTED;
+    }
+    break;
+
+  case L_ACCEPTED:
+    if (sim.dav) {
+      sim.ndac  = 0;
+      sim.received++;
+      sim.state = L_BUSY;
+      sim.next  = sim.now + delay;
+    }
+    break;
+  }
+}
+
+/* replacements for the bus access of ieee.c */
+static uint8_t sim_line(uint8_t *line) {
+  sim_update();
+  return *line;
+}
+
+#define IEEE_ATN  sim_line(&sim.atn)
+#define IEEE_NRFD sim_line(&sim.nrfd)
+#define IEEE_NDAC sim_line(&sim.ndac)
+
+static tick_t getticks(void) {
+  return sim.now++;
+}
+
+static void ieee_ports_talk(void) {
+  sim.ports_talk++;
+}
+
+static void set_eoi_state(uint8_t x) {
+  sim.eoi = x;
+}
+
+static void set_dav_state(uint8_t x) {
+  sim.dav = x;
+  sim_update();
+}
+
+static void set_ieee_data(uint8_t data) {
+  sim.data = data;
+  if (sim.put++ == sim.atn_byte) {
+    sim.atn      = 0;
+    sim.atn_time = sim.now;
+  }
+}
+
+static void _delay_us(unsigned us) {
+  (void)us;
+  sim.settled++;
+  if (sim.put - 1 == sim.atn_settle) {
+    sim.atn      = 0;
+    sim.atn_time = sim.now;
+  }
+}
+
+#include "putblock.c"
+
+/* report the result of a single check */
+static void check(int ok, const char *what) {
+  if (!ok) {
+    printf("FAIL: %s\n", what);
+    failures++;
+  }
+}
+
+/* reset the listener to ready, accepting every byte after delay ticks */
+static void sim_reset(uint32_t delay) {
+  memset(&sim, 0, sizeof(sim));
+  sim.atn  = 1;
+  sim.dav  = 1;
+  sim.eoi  = 1;
+  sim.nrfd = 0;
+  sim.ndac = 0;
+  sim.delay      = delay;
+  sim.stall_byte = ~0U;
+  sim.atn_byte   = ~0U;
+  sim.atn_settle = ~0U;
+  memset(rxdata, 0, sizeof(rxdata));
+  memset(rxeoi, 0, sizeof(rxeoi));
+  stat_bytes = 0;
+}
+
+/* count the received bytes that were sent with EOI */
+static unsigned count_eoi(void) {
+  unsigned i, count = 0;
+
+  for (i = 0; i < sim.received; i++)
+    count += rxeoi[i];
+
+  return count;
+}
+
+/* send data[first..last], return the result of ieee_putblock */
+static uint8_t send(uint8_t *data, uint8_t first, uint8_t last, uint8_t eoi) {
+  buffer_t buf;
+  uint8_t  res;
+
+  buf.data     = data;
+  buf.position = first;
+  buf.lastused = last;
+  buf.sendeoi  = eoi;
+  res = ieee_putblock(&buf);
+  position = buf.position;
+
+  return res;
+}
+
+int main(void) {
+  static uint8_t block[256];
+  unsigned i;
+  uint8_t  res;
+
+  for (i = 0; i < sizeof(block); i++)
+    block[i] = i * 13 + 5;
+
+  /* a full block with EOI on the last byte */
+  sim_reset(1);
+  res = send(block, 0, 255, 1);
+  check(res == 0, "full block sent");
+  check(sim.received == 256 && !memcmp(rxdata, block, 256), "full block data");
+  check(count_eoi() == 1 && rxeoi[255], "EOI only with the last byte");
+  check(stat_bytes == 256, "full block counted");
+  check(sim.ports_talk == 1, "ports switched once per block");
+  check(sim.dav, "DAV released after the block");
+
+  /* a partial block without EOI */
+  sim_reset(1);
+  res = send(block, 2, 9, 0);
+  check(res == 0, "partial block sent");
+  check(sim.received == 8 && !memcmp(rxdata, block + 2, 8), "partial block data");
+  check(count_eoi() == 0, "no EOI without sendeoi");
+  check(stat_bytes == 8, "partial block counted");
+
+  /* a slow listener: each phase is below the timeout, all three are not */
+  sim_reset(IEEE_TIMEOUT_MS * 2 / 3);
+  res = send(block, 0, 3, 1);
+  check(res == 0, "slow listener");
+  check(sim.received == 4 && !memcmp(rxdata, block, 4), "slow listener data");
+
+  /* a listener that does not accept a byte */
+  sim_reset(1);
+  sim.stall_byte = 5;
+  res = send(block, 10, 40, 1);
+  check(res == TIMEOUT_ABORT, "timeout");
+  check(position == 15 && sim.received == 5, "position after timeout");
+  check(stat_bytes == 5, "bytes counted before timeout");
+
+  /* ATN when the data is put on the bus */
+  sim_reset(1);
+  sim.atn_byte = 3;
+  res = send(block, 0, 20, 1);
+  check(res == ATN_POLLED, "ATN before settling");
+  check(position == 3 && sim.received == 3, "position after ATN before settling");
+  check(sim.settled == 3, "no settling after ATN");
+  check(sim.now == sim.atn_time && sim.dav, "no handshake after ATN before settling");
+  check(stat_bytes == 3, "bytes counted before ATN");
+
+  /* ATN while the data settles */
+  sim_reset(1);
+  sim.atn_settle = 4;
+  res = send(block, 0, 20, 1);
+  check(res == ATN_POLLED, "ATN while settling");
+  check(position == 4 && sim.received == 4, "position after ATN while settling");
+  check(sim.now == sim.atn_time && sim.dav, "no handshake after ATN while settling");
+  check(count_eoi() == 0, "no EOI after ATN");
+
+  if (failures) {
+    printf("%u checks failed\n", failures);
+    return 1;
+  }
+
+  printf("all checks passed\n");
+  return 0;
+}